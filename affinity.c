@@ -0,0 +1,170 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#if defined(__linux)
+#include <sched.h>
+#include <sys/syscall.h>
+#elif defined(__FreeBSD__)
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/domainset.h>
+#endif
+
+/*
+ * Thread placement. --cpu_list pins thread number t (0 is the driver,
+ * workers count up from 1) to the t-th CPU of the list, wrapping around.
+ * --numa_policy sets the memory policy of the whole process before any
+ * database memory is allocated: local, interleave[:NODES] or bind:NODES.
+ */
+#define kMaxCpus 1024
+#define kMaxNodes 64
+
+static int cpus_[kMaxCpus];
+static int num_cpus_;
+
+/* Parse "0,2,4-7" into list; returns the number of entries or -1. */
+static int parse_list(const char *spec, int *list, int max) {
+  const char *p = spec;
+  int n = 0, lo, hi, len;
+
+  while (*p) {
+    if (sscanf(p, "%d-%d%n", &lo, &hi, &len) == 2) {
+      p += len;
+    } else if (sscanf(p, "%d%n", &lo, &len) == 1) {
+      hi = lo;
+      p += len;
+    } else {
+      return -1;
+    }
+    if (lo < 0 || hi < lo)
+      return -1;
+    for (; lo <= hi && n < max; lo++)
+      list[n++] = lo;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return -1;
+  }
+
+  return n;
+}
+
+static void set_numa_policy(const char *spec) {
+  int nodes[kMaxNodes];
+  const char *arg = strchr(spec, ':');
+  int num_nodes = 0, i;
+
+  if (arg != NULL) {
+    num_nodes = parse_list(arg + 1, nodes, kMaxNodes);
+    if (num_nodes <= 0) {
+      fprintf(stderr, "invalid NUMA node list '%s'\n", arg + 1);
+      exit(1);
+    }
+  }
+
+#if defined(__linux)
+  /* Policies from <linux/mempolicy.h>. */
+  unsigned long mask = 0;
+  int mode;
+
+  for (i = 0; i < num_nodes; i++)
+    mask |= 1UL << nodes[i];
+  if (starts_with(spec, "local")) {
+    mode = 0;
+  } else if (starts_with(spec, "interleave")) {
+    mode = 3;
+    if (num_nodes == 0)
+      mask = ~0UL;
+  } else if (starts_with(spec, "bind") && num_nodes > 0) {
+    mode = 2;
+  } else {
+    fprintf(stderr, "invalid NUMA policy '%s'\n", spec);
+    exit(1);
+  }
+  if (syscall(SYS_set_mempolicy, mode, mode ? &mask : NULL,
+              mode ? kMaxNodes : 0) != 0)
+    perror("set_mempolicy");
+#elif defined(__FreeBSD__)
+  domainset_t mask;
+  int policy;
+
+  DOMAINSET_ZERO(&mask);
+  for (i = 0; i < num_nodes; i++)
+    DOMAINSET_SET(nodes[i], &mask);
+  if (starts_with(spec, "local")) {
+    policy = DOMAINSET_POLICY_FIRSTTOUCH;
+    DOMAINSET_FILL(&mask);
+  } else if (starts_with(spec, "interleave")) {
+    policy = DOMAINSET_POLICY_ROUNDROBIN;
+    if (num_nodes == 0)
+      DOMAINSET_FILL(&mask);
+  } else if (starts_with(spec, "bind") && num_nodes > 0) {
+    policy = DOMAINSET_POLICY_PREFER;
+  } else {
+    fprintf(stderr, "invalid NUMA policy '%s'\n", spec);
+    exit(1);
+  }
+  if (cpuset_setdomain(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(mask),
+                       &mask, policy) != 0)
+    perror("cpuset_setdomain");
+#else
+  (void)i;
+  fprintf(stderr, "NUMA policies are not supported on this platform\n");
+#endif
+}
+
+void affinity_init() {
+  if (FLAGS_numa_policy != NULL)
+    set_numa_policy(FLAGS_numa_policy);
+
+  if (FLAGS_cpu_list != NULL) {
+    num_cpus_ = parse_list(FLAGS_cpu_list, cpus_, kMaxCpus);
+    if (num_cpus_ <= 0) {
+      fprintf(stderr, "invalid CPU list '%s'\n", FLAGS_cpu_list);
+      exit(1);
+    }
+  }
+  affinity_pin(0);
+}
+
+/* Pin the calling thread according to its thread number. */
+void affinity_pin(int thread) {
+  int cpu;
+
+  if (num_cpus_ == 0)
+    return;
+  cpu = cpus_[thread % num_cpus_];
+
+#if defined(__linux)
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    perror("sched_setaffinity");
+#elif defined(__FreeBSD__)
+  cpuset_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(set),
+                         &set) != 0)
+    perror("cpuset_setaffinity");
+#else
+  (void)cpu;
+#endif
+}
+
+/* CPUs threads can run on: the pinned list, or every online CPU. */
+int affinity_num_cpus() {
+  long n;
+
+  if (num_cpus_ > 0)
+    return num_cpus_;
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (int)n : 1;
+}
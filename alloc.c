@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * Count the heap traffic SQLite generates by wrapping its allocator.
+ * The counters are cumulative; callers take differences around the
+ * code they want to measure. SQLITE_DEFAULT_MEMSTATUS=0 disables
+ * SQLite's own accounting, so this is the only view of it we have.
+ */
+static sqlite3_mem_methods base_methods_;
+static uint64_t alloc_bytes_;
+static uint64_t alloc_calls_;
+static bool alloc_installed_;
+
+static void* counting_malloc(int n) {
+  __atomic_fetch_add(&alloc_bytes_, (uint64_t)n, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_calls_, 1, __ATOMIC_RELAXED);
+  return base_methods_.xMalloc(n);
+}
+
+static void* counting_realloc(void *p, int n) {
+  __atomic_fetch_add(&alloc_bytes_, (uint64_t)n, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_calls_, 1, __ATOMIC_RELAXED);
+  return base_methods_.xRealloc(p, n);
+}
+
+/* Must run before SQLite is initialized, i.e. before the first open. */
+void alloc_init() {
+  sqlite3_mem_methods methods;
+
+  if (alloc_installed_)
+    return;
+  if (sqlite3_config(SQLITE_CONFIG_GETMALLOC, &base_methods_) != SQLITE_OK)
+    return;
+  methods = base_methods_;
+  methods.xMalloc = counting_malloc;
+  methods.xRealloc = counting_realloc;
+  alloc_installed_ = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods) == SQLITE_OK;
+}
+
+uint64_t alloc_bytes() {
+  return __atomic_load_n(&alloc_bytes_, __ATOMIC_RELAXED);
+}
+
+uint64_t alloc_calls() {
+  return __atomic_load_n(&alloc_calls_, __ATOMIC_RELAXED);
+}
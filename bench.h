@@ -5,18 +5,31 @@
 #ifndef BENCH_H_
 #define BENCH_H_
 
+/* Expose POSIX and platform interfaces hidden by -std=c99 on glibc. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <sys/mman.h>
 
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#endif
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
 #include <sls_wal.h>
@@ -25,6 +38,8 @@
 
 #define kNumBuckets 154
 #define kNumData 1000000
+#define kMaxValueSize (64 * 1024 * 1024)
+#define kMaxSteadyWindow 64
 
 typedef struct Histogram {
   double min_;
@@ -43,14 +58,217 @@ typedef struct Raw {
 
 typedef struct Random {
   uint32_t seed_;
+  uint64_t s_[4];
+  bool xoshiro_;
 } Random;
 
+#define kFeistelRounds 4
+
+/* A pseudo-random permutation of [0, n_). */
+typedef struct Permutation {
+  uint64_t n_;
+  int half_bits_;
+  uint64_t mask_;
+  uint64_t keys_[kFeistelRounds];
+} Permutation;
+
 typedef struct RandomGenerator {
   char *data_;
   size_t data_size_;
   int pos_;
+  double compression_ratio_;
 } RandomGenerator;
 
+enum DistKind {
+  DIST_FIXED,
+  DIST_UNIFORM,
+  DIST_NORMAL,
+  DIST_PARETO,
+  DIST_EMPIRICAL
+};
+
+typedef struct ValueSizeDist {
+  int kind_;
+  int min_;
+  int max_;
+  double mean_;
+  double stddev_;
+  double alpha_;
+  int num_sizes_;
+  int *sizes_;
+  double *cdf_;
+} ValueSizeDist;
+
+/* Cumulative counts of calls into the OS layer, from iostat.c. */
+typedef struct IoStats {
+  uint64_t reads_;
+  uint64_t read_bytes_;
+  uint64_t writes_;
+  uint64_t write_bytes_;
+  uint64_t write_nanos_;
+  uint64_t syncs_;
+  uint64_t sync_nanos_;
+  uint64_t other_;
+  uint64_t fetches_;
+  uint64_t fetch_misses_;
+  /* Temporary files: sorter spills, temp tables and indexes. */
+  uint64_t temp_opens_;
+  uint64_t temp_reads_;
+  uint64_t temp_read_bytes_;
+  uint64_t temp_writes_;
+  uint64_t temp_write_bytes_;
+} IoStats;
+
+/* Parts of an operation timed by --phase_stats. */
+enum OpPhase {
+  OP_KEYGEN,
+  OP_VALUEGEN,
+  OP_BIND,
+  OP_STEP,
+  OP_RESET,
+  OP_BEGIN,
+  OP_COMMIT,
+  OP_COMMIT_WRITE,
+  OP_COMMIT_SYNC,
+  kNumOpPhases
+};
+
+enum TableLayout {
+  LAYOUT_ROWID_BLOB,
+  LAYOUT_INTEGER_PK,
+  LAYOUT_WITHOUT_ROWID
+};
+
+/* Checkpoints run by the wal hook or wal_checkpoint_run in wal.c. */
+typedef struct WalStats {
+  uint64_t checkpoints_;
+  uint64_t checkpoint_nanos_;
+  uint64_t max_checkpoint_nanos_;
+  uint64_t frames_;
+} WalStats;
+
+enum ReadKind {
+  READ_POINT,
+  READ_SCAN,
+  kNumReadKinds
+};
+
+/* What the writer was doing while a read ran. */
+enum ReadPhase {
+  PHASE_IDLE,
+  PHASE_COMMIT,
+  PHASE_CHECKPOINT,
+  kNumReadPhases
+};
+
+typedef struct ConcurrentStats {
+  Histogram reads_[kNumReadKinds][kNumReadPhases];
+  Histogram commits_;
+  long num_reads_;
+  long txns_;
+  long rows_;
+  long checkpoints_;
+  uint64_t checkpoint_nanos_;
+  uint64_t max_checkpoint_nanos_;
+  double seconds_;
+} ConcurrentStats;
+
+enum RmwStep {
+  RMW_BEGIN,
+  RMW_READ,
+  RMW_WRITE,
+  RMW_COMMIT,
+  kNumRmwSteps
+};
+
+enum JsonStmt {
+  JSON_INSERT,
+  JSON_LOOKUP,
+  JSON_UPDATE,
+  kNumJsonStmts
+};
+
+enum QueryType {
+  QUERY_AGGREGATE,
+  QUERY_GROUP,
+  QUERY_TOPN,
+  QUERY_SORT,
+  QUERY_JOIN,
+  kNumQueryTypes
+};
+
+/* Work done by a run of analytic queries, from the statement and VFS. */
+typedef struct QueryStats {
+  IoStats io_;
+  long queries_;
+  long rows_;
+  long result_rows_;
+  int sorts_;
+  int autoindex_rows_;
+  int vm_steps_;
+  uint64_t temp_opens_;
+  uint64_t temp_read_bytes_;
+  uint64_t temp_write_bytes_;
+} QueryStats;
+
+/* Read-modify-write clients; busy_ counts SQLITE_BUSY by failing step. */
+typedef struct RmwStats {
+  Histogram latency_;
+  int clients_;
+  bool counters_;
+  long txns_;
+  long keys_;
+  long retries_;
+  long aborts_;
+  long busy_[kNumRmwSteps];
+  long busy_waits_;
+  uint64_t busy_nanos_;
+  int64_t read_bytes_;
+  long lost_updates_;
+  double seconds_;
+} RmwStats;
+
+typedef struct GroupCommitStats {
+  Histogram latency_;
+  long requests_;
+  long batches_;
+  long max_batch_;
+  uint64_t syncs_;
+} GroupCommitStats;
+
+/* Peak and steady-state memory over one benchmark, in bytes. */
+typedef struct MemStats {
+  uint64_t rss_peak_;
+  uint64_t rss_steady_;
+  uint64_t anon_peak_;
+  uint64_t anon_steady_;
+  uint64_t file_peak_;
+  uint64_t file_steady_;
+  uint64_t heap_peak_;
+  uint64_t heap_steady_;
+  uint64_t pcache_peak_;
+  uint64_t pcache_steady_;
+  uint64_t mmap_peak_;
+  uint64_t mmap_steady_;
+  int samples_;
+} MemStats;
+
+/* Outcome of one benchmark, averaged over its repetitions. */
+typedef struct Result {
+  char name_[64];
+  char config_[512];
+  double micros_per_op_;
+  double ops_per_sec_;
+  double p50_;
+  double p99_;
+  double rss_peak_mb_;
+  double rss_steady_mb_;
+  double warmup_secs_;
+  double measured_secs_;
+  int num_runs_;
+  double *runs_;
+} Result;
+
 // Comma-separated list of operations to run in the specified order
 //   Actual benchmarks:
 //
@@ -66,23 +284,88 @@ typedef struct RandomGenerator {
 //   readseq       -- read N times sequentially
 //   readrandom    -- read N times in random order
 //   readrand100K  -- read N/1000 100K values in sequential order in async mode
+//   updateseq     -- update N values in place in sequential key order
+//   updaterandom  -- update N values in place in random key order
+//   deleteseq     -- delete N values in sequential key order
+//   deleterandom  -- delete N values in random key order
+//   churnseq      -- delete the oldest key and insert a new one, N times
+//   churnrandom   -- delete a random key and insert a new one, N times
+//   scanseq       -- range scans of scan_length rows from sequential keys
+//   scanrandom    -- range scans of scan_length rows from random keys
+//   aging         -- scan fresh, aged and vacuumed tables and time VACUUM
+//   blobread      -- read blob_io_size bytes of a value with sqlite3_blob_read
+//   blobwrite     -- overwrite blob_io_size bytes of a value with sqlite3_blob_write
+//   rowread       -- read a whole value with SELECT and copy blob_io_size bytes
+//   rowwrite      -- patch blob_io_size bytes of a value with SELECT + UPDATE
+//   readwhilewriting -- reader threads under a rate-limited writer
+//   groupcommit   -- client threads sharing transactions through one committer
+//   groupcommitsync -- groupcommit with synchronous=FULL
+//   load          -- build the table of num_keys rows in key order, with progress
+//   readrandommiss -- readrandom that reports page cache, mmap and fault misses
+//   rmwrandom     -- client threads that read a value and write it back in one txn
+//   incrandom     -- client threads that increment counters with read-then-write
+//   jsonfillseq   -- write JSON documents in key order
+//   jsonfillrandom -- write JSON documents in random key order
+//   jsonreadrandom -- look up JSON documents by a nested path through its index
+//   jsonupdaterandom -- set one field of random JSON documents with json_set
+//   queryagg      -- COUNT/SUM/AVG over a range of query_rows keys
+//   querygroup    -- GROUP BY a column derived from the value over a range
+//   querytopn     -- ORDER BY a derived column with LIMIT query_limit
+//   querysort     -- ORDER BY a derived column returning the whole range
+//   queryjoin     -- join a range against the groups of another range
+//
+//   Any fill, read or rw benchmark can take a size suffix such as 4K or
+//   100K to run N/1000 operations on values of that many KB.
 extern char* FLAGS_benchmarks;
 
 // Number of key/values to place in the database.
-extern int FLAGS_num_keys;
+extern long FLAGS_num_keys;
 
 // Number of operations to do for the benchmark.
 extern long FLAGS_num_ops;
 
 // Number of read operations to do.  If negative, do FLAGS_num reads.
-extern int FLAGS_reads;
+extern long FLAGS_reads;
 
 // Size of each value
 extern int FLAGS_value_size;
 
+// Distribution of value sizes (fixed, uniform:MIN:MAX, normal:MEAN:STDDEV,
+// pareto:MIN:ALPHA[:MAX] or file:PATH). NULL means FLAGS_value_size.
+extern char* FLAGS_value_size_dist;
+
 // Print histogram of operation timings
 extern bool FLAGS_histogram;
 
+// Number of unmeasured operations to run before each measurement.
+extern long FLAGS_warmup_ops;
+
+// Reopen the database with its files evicted from the OS page cache
+// before each read benchmark.
+extern bool FLAGS_cold;
+
+// Run each benchmark for this many seconds instead of a fixed op count.
+extern double FLAGS_duration;
+
+// If positive, warm up until interval throughput cv drops below this.
+extern double FLAGS_steady_cv;
+
+// Number of intervals the steady-state cv is computed over.
+extern int FLAGS_steady_window;
+
+// Length of a steady-state interval in milliseconds.
+extern int FLAGS_steady_interval_ms;
+
+// Number of times to run each benchmark from the same database state.
+extern int FLAGS_repetitions;
+
+// If positive, keep repeating until the coefficient of variation of
+// throughput drops below this fraction (or FLAGS_max_repetitions is hit).
+extern double FLAGS_cv_threshold;
+
+// Upper bound on repetitions when FLAGS_cv_threshold is set.
+extern int FLAGS_max_repetitions;
+
 // Print raw data
 extern bool FLAGS_raw;
 
@@ -111,9 +394,159 @@ extern bool FLAGS_transaction;
 // If true, we enable Write-Ahead Logging
 extern bool FLAGS_WAL_enabled;
 
+// Journal mode (DELETE, TRUNCATE, PERSIST, MEMORY, WAL or OFF). If set,
+// this overrides FLAGS_WAL_enabled.
+extern char* FLAGS_journal_mode;
+
+// Synchronous mode (OFF, NORMAL, FULL or EXTRA). If NULL, sync and
+// batch benchmarks use FULL and all others OFF.
+extern char* FLAGS_synchronous;
+
+// Write results as JSON to this path.
+extern char* FLAGS_json;
+
+// Compare two JSON result files ("baseline.json,current.json") and exit.
+extern char* FLAGS_compare;
+
+// Percentage change in throughput or p99 that --compare flags as a regression.
+extern double FLAGS_regression_threshold;
+
+// Parameter sweep specification, e.g. "page_size=1024,4096;num_pages=1000:16000:x2".
+extern char* FLAGS_sweep;
+
 // Configure how many pages to use for WAL
 extern int FLAGS_checkpoint_granularity;
 
+// auto_vacuum mode for new databases (NONE, FULL or INCREMENTAL).
+extern char* FLAGS_auto_vacuum;
+
+// Run PRAGMA incremental_vacuum every this many operations (0 = never).
+extern int FLAGS_incremental_vacuum_interval;
+
+// Pages to free per incremental_vacuum (0 = the whole freelist).
+extern int FLAGS_incremental_vacuum_pages;
+
+// Print throughput, database size and freelist every this many ops.
+extern int FLAGS_stats_interval;
+
+// Random overwrites and deletes applied by the aging benchmark (0 = N).
+extern long FLAGS_aging_ops;
+
+// Percentage of aging operations that delete instead of overwrite.
+extern int FLAGS_aging_delete_percent;
+
+// Rows read by each range scan.
+extern int FLAGS_scan_length;
+
+// Bytes read or written per operation by the blob and row range benchmarks.
+extern int FLAGS_blob_io_size;
+
+// Run read benchmarks with mmap off, over half and over all of the file.
+extern bool FLAGS_mmap_compare;
+
+// madvise hint for the mmap region: NORMAL, RANDOM, SEQUENTIAL or WILLNEED.
+extern char* FLAGS_madvise;
+
+// Print VFS calls and page faults per operation after each benchmark.
+extern bool FLAGS_io_stats;
+
+// SQLite locking mode: EXCLUSIVE (default) or NORMAL, which uses WAL shared
+// memory and lets other connections read.
+extern char* FLAGS_locking_mode;
+
+// Reader threads for readwhilewriting.
+extern int FLAGS_threads;
+
+// Writer transactions per second for readwhilewriting (0 = unthrottled).
+extern int FLAGS_write_rate;
+
+// Percentage of readwhilewriting reads that are range scans.
+extern int FLAGS_reader_scan_percent;
+
+// Most requests the group committer applies in one transaction.
+extern int FLAGS_group_commit_max;
+
+// Microseconds the oldest pending request waits for others to join it.
+extern int FLAGS_group_commit_wait_us;
+
+// Table layout: rowid_blob, integer_pk or without_rowid.
+extern char* FLAGS_table_layout;
+
+// Blob key encoding: ascii (16-byte decimal) or binary (8-byte big-endian).
+extern char* FLAGS_key_encoding;
+
+// CPUs to pin threads to, e.g. "0,2,4-7"; thread t runs on the t-th entry.
+extern char* FLAGS_cpu_list;
+
+// NUMA memory policy: local, interleave[:NODES] or bind:NODES.
+extern char* FLAGS_numa_policy;
+
+// Rerun threaded benchmarks at 1, 2, 4, ... up to FLAGS_threads threads.
+extern bool FLAGS_scaling;
+
+// Time key generation, bind, step, reset, BEGIN and COMMIT separately.
+extern bool FLAGS_phase_stats;
+
+// Sample memory use every this many milliseconds (0 = off).
+extern int FLAGS_mem_sample_ms;
+
+// Run the PGO training mix instead of FLAGS_benchmarks.
+extern bool FLAGS_pgo_training;
+
+// Size num_keys so the raw dataset is this many times physical memory.
+extern double FLAGS_dataset_ram_ratio;
+
+// Random generator for keys and workloads: park_miller or xoshiro.
+extern char* FLAGS_rng;
+
+// Random-order writes visit each key once, via a random permutation.
+extern bool FLAGS_unique_keys;
+
+// Serve live statistics on this Unix-domain socket (NULL = off).
+extern char* FLAGS_export_socket;
+
+// Log operations that take at least this many microseconds (0 = off).
+extern int FLAGS_slow_op_us;
+
+// File the slow operations are logged to, one JSON object per line.
+extern char* FLAGS_slow_op_log;
+
+// Record WAL growth and checkpoints per benchmark to this CSV (NULL = off).
+extern char* FLAGS_wal_timeline;
+
+// How transactions begin: deferred, immediate or exclusive.
+extern char* FLAGS_txn_mode;
+
+// Longest a busy handler waits for one lock, in ms (0 = no handler).
+extern int FLAGS_busy_timeout_ms;
+
+// Times a transaction that got SQLITE_BUSY is retried before aborting.
+extern int FLAGS_busy_retries;
+
+// Rows in the counters table incrandom increments.
+extern long FLAGS_counter_rows;
+
+// Fields per object of a generated JSON document.
+extern int FLAGS_json_fields;
+
+// Levels of nested objects in a generated JSON document.
+extern int FLAGS_json_depth;
+
+// How documents are stored: text or jsonb.
+extern char* FLAGS_json_storage;
+
+// How lookups by path are indexed: expression, virtual or stored.
+extern char* FLAGS_json_index;
+
+// Keys in the range each analytic query covers.
+extern long FLAGS_query_rows;
+
+// Rows returned by the top-N query.
+extern int FLAGS_query_limit;
+
+// PRAGMA temp_store: DEFAULT, FILE or MEMORY (NULL = leave as built).
+extern char* FLAGS_temp_store;
+
 // Configure the write percentage for mixed read/write benchmarks.
 int FLAGS_write_percent;
 
@@ -137,11 +570,108 @@ void histogram_clear(Histogram*);
 void histogram_add(Histogram*, double);
 void histogram_merge(Histogram*, const Histogram*);
 char* histogram_to_string(Histogram*);
+double histogram_percentile(Histogram*, double);
+double histogram_bucket_limit(int);
+
+/* alloc.c */
+void alloc_init(void);
+uint64_t alloc_bytes(void);
+uint64_t alloc_calls(void);
+
+/* iostat.c */
+void iostat_init(const char*);
+void iostat_get(IoStats*);
+
+/* export.c */
+void export_init(const char*);
+bool export_enabled(void);
+void export_benchmark(const char*, const char*);
+void export_publish(long, int64_t, double, bool, const Histogram*,
+                    const Histogram*);
+void export_tick(long, int64_t, double, const Histogram*, const Histogram*);
+
+/* slowop.c */
+void slowop_open(const char*);
+void slowop_benchmark(const char*);
+void slowop_reset(sqlite3*);
+void slowop_txn_begin(void);
+void slowop_record(bool, long, double);
+void slowop_print(void);
+
+/* wal.c */
+void wal_hook_install(sqlite3*, int);
+uint64_t wal_checkpoint_seq(void);
+int wal_frames(void);
+void wal_checkpoint_run(sqlite3*, int);
+void wal_timeline_open(const char*);
+void wal_timeline_start(int);
+void wal_timeline_stop(const char*);
+void wal_stats_reset_max(void);
+void wal_stats_get(WalStats*);
+
+/* concurrent.c */
+void concurrent_run(const char*, int, bool, int, long, ValueSizeDist*, long,
+                    ConcurrentStats*);
+void concurrent_print(ConcurrentStats*);
+sqlite3* concurrent_open(const char*);
+
+/* rmw.c */
+const char* txn_begin_sql(void);
+void rmw_run(sqlite3*, bool, int, long, long, ValueSizeDist*, int, RmwStats*);
+void rmw_print(RmwStats*);
+
+/* json.c */
+bool json_init(void);
+const char* json_storage_name(void);
+const char* json_index_name(void);
+const char* json_generate(Random*, long, int, int*);
+void json_create(sqlite3*);
+long json_count(sqlite3*);
+sqlite3_stmt* json_stmt(sqlite3*, enum JsonStmt);
+void json_finalize(void);
+
+/* query.c */
+const char* query_name(enum QueryType);
+sqlite3_stmt* query_stmt(sqlite3*, enum QueryType);
+void query_finalize(void);
+void query_stats_start(QueryStats*, sqlite3_stmt*);
+void query_stats_stop(QueryStats*, sqlite3_stmt*);
+void query_stats_format(const QueryStats*, double, char*, size_t);
+
+/* groupcommit.c */
+void groupcommit_run(sqlite3*, int, long, long, ValueSizeDist*,
+                     GroupCommitStats*);
+
+/* key.c */
+void key_init(void);
+int key_layout(void);
+const char* key_layout_name(void);
+int key_size(void);
+const char* key_schema(void);
+void bind_key(sqlite3_stmt*, int, char*, long);
+void key_trace(bool);
+long key_last(void);
+long key_binds(void);
+
+/* memstat.c */
+void memstat_init(void);
+void memstat_start(const char*);
+void memstat_stop(MemStats*);
+void memstat_print(const MemStats*);
+
+/* affinity.c */
+void affinity_init(void);
+void affinity_pin(int);
+int affinity_num_cpus(void);
 
 /* benchmark.c */
 void benchmark_init(void);
 void benchmark_run(void);
 void benchmark_fini(void);
+void benchmark_destroy(void);
+int benchmark_num_results(void);
+Result* benchmark_result(int);
+void benchmark_clear_results(void);
 
 /* Raw */
 void raw_clear(Raw *);
@@ -153,12 +683,47 @@ void raw_print(FILE *, Raw *);
 void rand_init(Random*, uint32_t);
 uint32_t rand_next(Random*);
 uint32_t rand_uniform(Random*, int);
+long rand_key(Random*, long);
+void rand_select(const char*);
+void rand_seed(Random*, uint32_t, int);
+void perm_init(Permutation*, long, uint64_t);
+long perm_at(const Permutation*, long);
+double rand_double(Random*);
 void rand_gen_init(RandomGenerator*, double);
-char* rand_gen_generate(RandomGenerator*, int);
+const char* rand_gen_generate(RandomGenerator*, int);
+void value_dist_fixed(ValueSizeDist*, int);
+bool value_dist_init(ValueSizeDist*, const char*, int);
+int value_dist_next(ValueSizeDist*, Random*);
+
+/* report.c */
+void report_config(char*, size_t);
+void report_open(const char*);
+void report_add(const Result*);
+void report_close(void);
+
+/* compare.c */
+int compare_run(const char*, const char*);
+
+/* sweep.c */
+void sweep_run(void);
+
+/* stats.c */
+double stats_mean(const double*, int);
+double stats_median(const double*, int);
+double stats_stddev(const double*, int);
+double stats_cv(const double*, int);
+double stats_t_critical(double);
+double stats_ci95(const double*, int);
+bool stats_welch(const double*, int, const double*, int, double*, double*);
 
 /* util.c */
 uint64_t now_micros(void);
+uint64_t now_nanos(void);
+uint64_t phys_mem_bytes(void);
+void deadline_set(double);
+bool deadline_passed(void);
 bool starts_with(const char*, const char*);
 char* trim_space(const char*);
+double file_evict(const char*);
 
 #endif /* BENCH_H_ */
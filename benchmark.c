@@ -5,6 +5,7 @@
 #include "bench.h"
 
 #define RAWFILE ("/tmp/raw")
+#define kNumSizeClasses 24
 
 enum Order {
   SEQUENTIAL,
@@ -21,11 +22,109 @@ enum OpKind{
   WRITE
 };
 
+/*
+ * Per size class throughput. Class 0 holds rows that fit on their
+ * b-tree leaf, class c > 0 holds rows that spill into [2^(c-1), 2^c)
+ * overflow pages.
+ */
+typedef struct SizeClass {
+  long ops_;
+  int64_t bytes_;
+  uint64_t nanos_;
+} SizeClass;
+
+enum BenchType {
+  BENCH_UNKNOWN,
+  BENCH_FILL,
+  BENCH_RW,
+  BENCH_READ,
+  BENCH_UPDATE,
+  BENCH_DELETE,
+  BENCH_CHURN,
+  BENCH_SCAN,
+  BENCH_AGING,
+  BENCH_BLOB_READ,
+  BENCH_BLOB_WRITE,
+  BENCH_ROW_READ,
+  BENCH_ROW_WRITE,
+  BENCH_CONCURRENT,
+  BENCH_GROUP_COMMIT,
+  BENCH_LOAD,
+  BENCH_READ_MISS,
+  BENCH_RMW,
+  BENCH_INCREMENT,
+  BENCH_JSON_FILL,
+  BENCH_JSON_READ,
+  BENCH_JSON_UPDATE,
+  BENCH_QUERY
+};
+
+/* Rows per transaction when loading, and seconds between progress lines. */
+#define kLoadTxnRows 65536
+#define kLoadProgressSecs 10
+
+/* Everything benchmark_run derives from a benchmark name. */
+typedef struct Workload {
+  char *name_;
+  int type_;
+  int order_;
+  int batch_size_;
+  int value_size_;
+  ValueSizeDist big_dist_;
+  ValueSizeDist *dist_;
+  long num_ops_;
+  long num_reads_;
+  long num_entries_;
+  long prefill_entries_;
+  int prefill_value_size_;
+  int query_;                 /* enum QueryType for BENCH_QUERY */
+  long *keys_;                /* random delete/churn key order */
+  long mutated_;              /* update/delete/churn ops run so far */
+} Workload;
+
+/*
+ * Steady-state detector. While watching, the throughput of each
+ * FLAGS_steady_interval_ms interval goes into a ring of the last
+ * FLAGS_steady_window intervals; the run is steady once their cv drops
+ * below FLAGS_steady_cv.
+ */
+#define kSteadyCheckOps 64
+#define kSteadyMaxWindows 20
+
+typedef struct SteadyState {
+  bool watching_;
+  bool reached_;
+  double last_;
+  long last_done_;
+  int intervals_;
+  double cv_;
+  double tput_[kMaxSteadyWindow];
+} SteadyState;
+
+/*
+ * Cold reads. With --cold, a read benchmark starts on a reopened
+ * connection with the database evicted from the OS page cache. The run
+ * records the time to its first result and the throughput of each of
+ * kColdSlices equal slices of its ops, which traces the warm-up curve.
+ */
+#define kColdSlices 10
+
+typedef struct ColdCurve {
+  bool watching_;
+  long slice_ops_;
+  double open_;               /* seconds to reopen the connection */
+  double resident_;           /* fraction of the db still cached */
+  double first_;              /* seconds to the first result */
+  int slices_;
+  double ends_[kColdSlices];  /* end of each slice, from start_ */
+} ColdCurve;
+
+
 sqlite3* db_;
 int db_num_;
-int num_keys_;
+long num_keys_;
 long num_ops_;
-int reads_;
+long reads_;
 double start_;
 double last_op_finish_;
 int64_t bytes_;
@@ -35,8 +134,50 @@ Histogram hist_wr_;
 Raw raw_;
 RandomGenerator gen_;
 Random rand_;
-int done_;
+Permutation perm_;
+long done_;
+long loaded_entries_;
+int loaded_value_size_;
 FILE* rawfile_;
+int page_size_;
+ValueSizeDist value_dist_;
+SizeClass size_classes_[kNumSizeClasses];
+bool track_sizes_;
+bool track_latency_;
+Histogram phase_hist_[kNumOpPhases];
+Result last_result_;
+MemStats last_mem_;
+sqlite3* snap_db_;
+Result* results_;
+int num_results_;
+bool header_printed_;
+double last_interval_;
+long last_interval_done_;
+SteadyState steady_;
+ColdCurve cold_;
+
+/* Query counters of the current measurement, summed over its passes. */
+static QueryStats query_;
+static int query_type_;
+
+/* readrandommiss counters of the current measurement, over its passes. */
+typedef struct MissStats {
+  long lookups_;
+  long cache_lookups_;
+  long cache_pages_;
+  long map_lookups_;
+  long fault_lookups_;
+  Histogram hit_;
+  Histogram miss_;
+} MissStats;
+
+static MissStats miss_;
+static bool miss_active_;
+
+/* False once the table may have changed since its depth was measured. */
+static bool lookup_depth_valid_;
+
+static void print_interval_stats(void);
 
 inline
 static void exec_error_check(int status, char *err_msg) {
@@ -67,7 +208,7 @@ inline
 static void wal_checkpoint(sqlite3* db_) {
   /* Flush all writes to disk */
   if (FLAGS_WAL_enabled)
-    sqlite3_wal_checkpoint_v2(db_, NULL, SQLITE_CHECKPOINT_FULL, NULL, NULL);
+    wal_checkpoint_run(db_, SQLITE_CHECKPOINT_FULL);
 }
 
 static void print_warnings() {
@@ -83,6 +224,23 @@ static void print_warnings() {
 #endif
 }
 
+#if defined(__linux)
+static int count_numa_nodes(void) {
+  DIR *dir = opendir("/sys/devices/system/node");
+  struct dirent *ep;
+  int n = 0;
+
+  if (dir == NULL)
+    return 1;
+  while ((ep = readdir(dir)) != NULL)
+    if (starts_with(ep->d_name, "node") && isdigit((unsigned char)ep->d_name[4]))
+      n++;
+  closedir(dir);
+
+  return n > 0 ? n : 1;
+}
+#endif
+
 static void print_environment() {
   fprintf(stderr, "SQLite:     version %s\n", SQLITE_VERSION);
 #if defined(__linux)
@@ -93,6 +251,8 @@ static void print_environment() {
   if (cpuinfo != NULL) {
     char line[1000];
     int num_cpus = 0;
+    int cores_per_socket = 0, num_sockets = 0, id;
+    bool seen_socket[256] = { false };
     char* cpu_type = malloc(sizeof(char) * 1000);
     char* cache_size = malloc(sizeof(char) * 1000);
     while (fgets(line, sizeof(line), cpuinfo) != NULL) {
@@ -113,6 +273,14 @@ static void print_environment() {
         strcpy(cpu_type, trimed_val);
       } else if (!strcmp(trimed_key, "cache size")) {
         strcpy(cache_size, trimed_val);
+      } else if (!strcmp(trimed_key, "physical id")) {
+        id = atoi(trimed_val);
+        if (id >= 0 && id < 256 && !seen_socket[id]) {
+          seen_socket[id] = true;
+          num_sockets++;
+        }
+      } else if (!strcmp(trimed_key, "cpu cores")) {
+        cores_per_socket = atoi(trimed_val);
       }
       free(trimed_key);
       free(trimed_val);
@@ -120,46 +288,131 @@ static void print_environment() {
     fclose(cpuinfo);
     fprintf(stderr, "CPU:        %d * %s\n", num_cpus, cpu_type);
     fprintf(stderr, "CPUCache:   %s\n", cache_size);
+    fprintf(stderr, "Topology:   %d sockets * %d cores, %d hardware threads, "
+            "%d NUMA nodes\n", num_sockets ? num_sockets : 1,
+            cores_per_socket ? cores_per_socket : num_cpus, num_cpus,
+            count_numa_nodes());
     free(cpu_type);
     free(cache_size);
   }
+#elif defined(__FreeBSD__)
+  char model[256];
+  size_t len = sizeof(model);
+  int ncpu = 0, ndomains = 1;
+  size_t int_len = sizeof(int);
+
+  time_t now = time(NULL);
+  fprintf(stderr, "Date:       %s", ctime(&now));
+  if (sysctlbyname("hw.model", model, &len, NULL, 0) == 0 &&
+      sysctlbyname("hw.ncpu", &ncpu, &int_len, NULL, 0) == 0)
+    fprintf(stderr, "CPU:        %d * %s\n", ncpu, model);
+  int_len = sizeof(int);
+  sysctlbyname("vm.ndomains", &ndomains, &int_len, NULL, 0);
+  fprintf(stderr, "Topology:   %d hardware threads, %d NUMA domains\n", ncpu,
+          ndomains);
 #endif
+  if (FLAGS_cpu_list != NULL || FLAGS_numa_policy != NULL)
+    fprintf(stderr, "Placement:  cpus %s, numa %s\n",
+            FLAGS_cpu_list ? FLAGS_cpu_list : "any",
+            FLAGS_numa_policy ? FLAGS_numa_policy : "default");
 }
 
 static void print_header() {
-  const int kKeySize = 16;
   print_environment();
-  fprintf(stderr, "Entries:    %d\n", num_keys_);
-  fprintf(stderr, "Keys:       %d bytes each\n", kKeySize);
-  fprintf(stderr, "Values:     %d bytes each\n", FLAGS_value_size);  
+  fprintf(stderr, "Entries:    %ld\n", num_keys_);
+  fprintf(stderr, "Keys:       %d bytes each (%s, %s)\n", key_size(),
+          FLAGS_table_layout, FLAGS_key_encoding);
+  if (value_dist_.kind_ == DIST_FIXED)
+    fprintf(stderr, "Values:     %d bytes each\n", FLAGS_value_size);
+  else
+    fprintf(stderr, "Values:     %s (%d to %d bytes)\n",
+            FLAGS_value_size_dist, value_dist_.min_, value_dist_.max_);
   fprintf(stderr, "Operations:    %ld\n", num_ops_);
-  fprintf(stderr, "RawSize:    %.1f MB (estimated)\n",
-            (((int64_t)(kKeySize + FLAGS_value_size) * num_keys_)
-            / 1048576.0));
+  if (FLAGS_duration > 0)
+    fprintf(stderr, "Duration:   %.1f s per benchmark\n", FLAGS_duration);
+  fprintf(stderr, "RawSize:    %.1f MB (estimated, %.2fx RAM)\n",
+            (((int64_t)(key_size() + FLAGS_value_size) * num_keys_)
+            / 1048576.0),
+            (double)(key_size() + FLAGS_value_size) * num_keys_ /
+            phys_mem_bytes());
   print_warnings();
   fprintf(stderr, "------------------------------------------------\n");
 }
 
 static void start() {
+  int i;
+
   start_ =  now_micros() * 1e-6;
   bytes_ = 0;
   message_ = malloc(sizeof(char) * 10000);
   strcpy(message_, "");
   last_op_finish_ = start_;
+  last_interval_ = start_;
+  last_interval_done_ = 0;
   histogram_clear(&hist_wr_);
   histogram_clear(&hist_rd_);
+  for (i = 0; i < kNumOpPhases; i++)
+    histogram_clear(&phase_hist_[i]);
   raw_clear(&raw_);
+  memset(size_classes_, 0, sizeof(size_classes_));
   done_ = 0;
+  query_type_ = -1;
+  miss_active_ = false;
+  if (FLAGS_mem_sample_ms > 0)
+    memstat_start(sqlite3_db_filename(db_, "main"));
+  export_publish(0, 0, start_, true, &hist_rd_, &hist_wr_);
+  if (FLAGS_slow_op_us > 0)
+    slowop_reset(db_);
+  if (FLAGS_wal_timeline != NULL)
+    wal_timeline_start(page_size_);
+}
+
+/* Close the current interval if it is over and test for steady state. */
+static void steady_check(void) {
+  double now = now_micros() * 1e-6;
+  int n = FLAGS_steady_window;
+
+  if (now - steady_.last_ < FLAGS_steady_interval_ms * 1e-3)
+    return;
+  steady_.tput_[steady_.intervals_++ % n] =
+      (done_ - steady_.last_done_) / (now - steady_.last_);
+  steady_.last_ = now;
+  steady_.last_done_ = done_;
+  if (steady_.intervals_ < n)
+    return;
+  steady_.cv_ = stats_cv(steady_.tput_, n);
+  if (steady_.cv_ < FLAGS_steady_cv)
+    steady_.reached_ = true;
+}
+
+static void cold_track(void) {
+  double now = now_micros() * 1e-6 - start_;
+
+  if (done_ == 1)
+    cold_.first_ = now;
+  if (done_ % cold_.slice_ops_ == 0 && cold_.slices_ < kColdSlices)
+    cold_.ends_[cold_.slices_++] = now;
+}
+
+/* Benchmark loops end early once the run is steady or out of time. */
+static inline bool time_up(void) {
+  return steady_.reached_ || deadline_passed();
+}
+
+/* With --duration, threaded runs go until the deadline, not n ops. */
+static long duration_ops(long n) {
+  return FLAGS_duration > 0 ? LONG_MAX : n;
 }
 
 void finished_single_op(enum OpKind kind) {
   Histogram *hist = (kind == WRITE) ? &hist_wr_ : &hist_rd_;
 
-  if (FLAGS_histogram || FLAGS_raw) {
+  if (FLAGS_histogram || FLAGS_raw || track_latency_) {
     double now = now_micros() * 1e-6;
     double micros = (now - last_op_finish_) * 1e6;
-    if (FLAGS_histogram) {
+    if (FLAGS_histogram || track_latency_)
       histogram_add(hist, micros);
+    if (FLAGS_histogram) {
       if (micros > 20000) {
         fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
         fflush(stderr);
@@ -168,22 +421,173 @@ void finished_single_op(enum OpKind kind) {
     if (FLAGS_raw) {
       raw_add(&raw_, micros);
     }
+    if (FLAGS_slow_op_us > 0)
+      slowop_record(kind == WRITE, done_, micros);
     last_op_finish_ = now;
   }
 
   done_++;
+  if (cold_.watching_)
+    cold_track();
+  export_tick(done_, bytes_, start_, &hist_rd_, &hist_wr_);
+  if (steady_.watching_ && done_ % kSteadyCheckOps == 0)
+    steady_check();
+
+  if (FLAGS_stats_interval > 0 && done_ % FLAGS_stats_interval == 0)
+    print_interval_stats();
+}
+
+static int varint_len(uint64_t v) {
+  int n = 1;
+
+  while (v > 127 && n < 9) {
+    v >>= 7;
+    n++;
+  }
+
+  return n;
+}
+
+/*
+ * Number of overflow pages a row of the test table spills into, following
+ * the local payload rules for table b-tree leaves in the file format.
+ */
+static int overflow_pages(int key_len, int value_len) {
+  int64_t u = page_size_;
+  int64_t x = u - 35;
+  int64_t m = ((u - 12) * 32 / 255) - 23;
+  int64_t hdr, p, k, local;
+
+  hdr = varint_len(2 * key_len + 12) + varint_len(2 * value_len + 12);
+  hdr += varint_len(hdr + 1);
+  p = hdr + key_len + value_len;
+  if (p <= x)
+    return 0;
+
+  k = m + ((p - m) % (u - 4));
+  local = (k <= x) ? k : m;
+
+  return (int)((p - local + u - 5) / (u - 4));
+}
+
+static int size_class(int ovfl_pages) {
+  int c = 0;
+
+  while (ovfl_pages > 0 && c < kNumSizeClasses - 1) {
+    ovfl_pages >>= 1;
+    c++;
+  }
+
+  return c;
+}
+
+static void record_size_class(int key_len, int value_len, uint64_t nanos) {
+  SizeClass *sc = &size_classes_[size_class(overflow_pages(key_len, value_len))];
+
+  sc->ops_++;
+  sc->bytes_ += key_len + value_len;
+  sc->nanos_ += nanos;
+}
+
+static void print_size_classes() {
+  SizeClass *sc;
+  char range[32];
+  int c;
+
+  fprintf(stderr, "%-16s %10s %12s %12s %10s\n",
+          "Overflow pages", "Ops", "Avg bytes", "micros/op", "MB/s");
+  for (c = 0; c < kNumSizeClasses; c++) {
+    sc = &size_classes_[c];
+    if (sc->ops_ == 0)
+      continue;
+    if (c == 0)
+      snprintf(range, sizeof(range), "0 (inline)");
+    else if (c == 1)
+      snprintf(range, sizeof(range), "1");
+    else
+      snprintf(range, sizeof(range), "%d-%d", 1 << (c - 1), (1 << c) - 1);
+    fprintf(stderr, "%-16s %10ld %12.0f %12.3f %10.1f\n",
+            range, sc->ops_, (double)sc->bytes_ / sc->ops_,
+            sc->nanos_ * 1e-3 / sc->ops_,
+            (sc->bytes_ / 1048576.0) / (sc->nanos_ * 1e-9 + 1e-12));
+  }
+}
+
+/* Walk the table and report how many rows live on overflow chains. */
+static void print_overflow_stats() {
+  sqlite3_stmt *stmt;
+  long rows = 0, spilled = 0, pages = 0;
+  int max_chain = 0, n;
+  int status;
+
+  status = sqlite3_prepare_v2(db_,
+      "SELECT length(key), length(value) FROM test", -1, &stmt, NULL);
+  error_check(status);
+  while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+    n = overflow_pages(sqlite3_column_int(stmt, 0),
+                       sqlite3_column_int(stmt, 1));
+    rows++;
+    if (n > 0) {
+      spilled++;
+      pages += n;
+    }
+    if (n > max_chain)
+      max_chain = n;
+  }
+  step_error_check(status);
+  sqlite3_finalize(stmt);
+
+  fprintf(stderr, "Overflow:   %ld of %ld rows (%.1f%%) exceed %d bytes local "
+          "payload at page_size %d\n",
+          spilled, rows, rows ? 100.0 * spilled / rows : 0.0,
+          page_size_ - 35, page_size_);
+  fprintf(stderr, "Chains:     %ld overflow pages, avg %.2f max %d pages "
+          "per spilled row\n",
+          pages, spilled ? (double)pages / spilled : 0.0, max_chain);
+}
+
+static void read_miss_format(char *buf, size_t size) {
+  long n = miss_.lookups_;
+
+  snprintf(buf, size, "(page cache miss %.1f%% of lookups, %.2f pages; "
+           "outside mmap %.1f%%; major fault %.1f%%; p50 hit %.1f miss %.1f us)",
+           n ? 100.0 * miss_.cache_lookups_ / n : 0.0,
+           miss_.cache_lookups_ ?
+               (double)miss_.cache_pages_ / miss_.cache_lookups_ : 0.0,
+           n ? 100.0 * miss_.map_lookups_ / n : 0.0,
+           n ? 100.0 * miss_.fault_lookups_ / n : 0.0,
+           miss_.hit_.num_ > 0 ? histogram_percentile(&miss_.hit_, 50) : 0.0,
+           miss_.miss_.num_ > 0 ? histogram_percentile(&miss_.miss_, 50) : 0.0);
 }
 
 static void stop(const char* name) {
   double finish = now_micros() * 1e-6;
+  Histogram all;
 
   if (done_ < 1) done_ = 1;
 
+  histogram_clear(&all);
+  histogram_merge(&all, &hist_wr_);
+  histogram_merge(&all, &hist_rd_);
+  last_result_.micros_per_op_ = (finish - start_) * 1e6 / done_;
+  last_result_.ops_per_sec_ = done_ / (finish - start_);
+  last_result_.measured_secs_ = finish - start_;
+  last_result_.p50_ = all.num_ > 0 ? histogram_percentile(&all, 50) : 0;
+  last_result_.p99_ = all.num_ > 0 ? histogram_percentile(&all, 99) : 0;
+
+  if (query_type_ >= 0) {
+    query_stats_stop(&query_, query_stmt(db_, query_type_));
+    query_stats_format(&query_, finish - start_, message_, 10000);
+  }
+  if (miss_active_)
+    read_miss_format(message_, 10000);
+
   if (bytes_ > 0) {
-    char *rate = malloc(sizeof(char) * 100);;
-    snprintf(rate, strlen(rate), "%6.1f MB/s",
+    char *rate = malloc(sizeof(char) * 100);
+    snprintf(rate, 100, "%6.1f MB/s",
               (bytes_ / 1048576.0) / (finish - start_));
-    if (message_ && !strcmp(message_, "")) {
+    if (message_ && strcmp(message_, "")) {
+      rate = realloc(rate, strlen(rate) + strlen(message_) + 2);
       message_ = strcat(strcat(rate, " "), message_);
     } else {
       message_ = rate;
@@ -195,6 +599,15 @@ static void stop(const char* name) {
           (finish - start_) * 1e6 / done_,
           (!message_ || !strcmp(message_, "") ? "" : " "),
           (!message_) ? "" : message_);
+  export_publish(done_, bytes_, start_, false, &hist_rd_, &hist_wr_);
+  if (FLAGS_slow_op_us > 0)
+    slowop_print();
+  if (FLAGS_wal_timeline != NULL && FLAGS_WAL_enabled)
+    wal_timeline_stop(name);
+  if (FLAGS_mem_sample_ms > 0) {
+    memstat_stop(&last_mem_);
+    memstat_print(&last_mem_);
+  }
   if (FLAGS_raw) {
     raw_print(rawfile_, &raw_);
   }
@@ -204,6 +617,10 @@ static void stop(const char* name) {
     fprintf(stderr, "Microseconds per read op:\n%s\n",
             histogram_to_string(&hist_rd_));
   }
+  if (track_sizes_) {
+    print_size_classes();
+    print_overflow_stats();
+  }
   fflush(stdout);
   fflush(stderr);
 }
@@ -213,6 +630,11 @@ enum stmt_types {
 	STMT_TEND,
 	STMT_READ,
 	STMT_REPLACE,
+	STMT_UPDATE,
+	STMT_DELETE,
+	STMT_SCAN,
+	STMT_ROWID,
+	STMT_VALUE,
   STMT_TYPES,
 };
 
@@ -223,11 +645,23 @@ char *stmt_text[STMT_TYPES] = {
    "COMMIT TRANSACTION",
    "SELECT * FROM test WHERE key = ?",
    "REPLACE INTO test (key, value) VALUES (?, ?)",
+   "UPDATE test SET value = ? WHERE key = ?",
+   "DELETE FROM test WHERE key = ?",
+   "SELECT key, value FROM test WHERE key >= ? ORDER BY key LIMIT ?",
+   "SELECT rowid FROM test WHERE key = ?",
+   "SELECT value FROM test WHERE key = ?",
 };
 
 void stmt_prepare(void) {
   int status, i;
+
+  stmt_text[STMT_TSTART] = (char *)txn_begin_sql();
   for (i = 0; i < STMT_TYPES; i++) {
+    /* WITHOUT ROWID tables have no rowid to look up. */
+    if (i == STMT_ROWID && key_layout() == LAYOUT_WITHOUT_ROWID) {
+      stmts[i] = NULL;
+      continue;
+    }
     status = sqlite3_prepare_v2(db_, stmt_text[i], -1,
                                 &stmts[i], NULL);
     error_check(status);
@@ -256,16 +690,97 @@ static void set_pragma_str(char *pragma, char *val) {
   exec_error_check(status, err_msg);
 }
 
-static void set_pragma_int(char *pragma, int val) {
+static void set_pragma_int(char *pragma, long val) {
   char stmt[STMT_SIZE];
   char *err_msg;
   int status;
   
-  snprintf(stmt, STMT_SIZE, "PRAGMA %s = %d", pragma, val);
+  snprintf(stmt, STMT_SIZE, "PRAGMA %s = %ld", pragma, val);
   status = sqlite3_exec(db_, stmt, NULL, NULL, &err_msg);
   exec_error_check(status, err_msg);
 }
 
+static long get_pragma_int(char *pragma) {
+  char stmt_str[STMT_SIZE];
+  sqlite3_stmt *stmt;
+  long val = 0;
+  int status;
+
+  snprintf(stmt_str, STMT_SIZE, "PRAGMA %s", pragma);
+  status = sqlite3_prepare_v2(db_, stmt_str, -1, &stmt, NULL);
+  error_check(status);
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    val = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return val;
+}
+
+static int64_t file_size(const char *path) {
+  struct stat st;
+
+  return stat(path, &st) == 0 ? (int64_t)st.st_size : 0;
+}
+
+typedef struct IoSample {
+  IoStats io_;
+  struct rusage usage_;
+} IoSample;
+
+static void io_sample(IoSample *s) {
+  iostat_get(&s->io_);
+  getrusage(RUSAGE_SELF, &s->usage_);
+}
+
+/* Per-operation VFS calls and page faults between two samples. */
+static void print_io_stats(const IoSample *a, const IoSample *b, long ops) {
+  double n = ops > 0 ? ops : 1;
+
+  fprintf(stderr, "  I/O per op: %.2f pread (%.1f KB), %.2f pwrite (%.1f KB), "
+          "%.3f sync, %.2f other syscalls, %.2f mmap fetch, %.2f fetch miss\n",
+          (b->io_.reads_ - a->io_.reads_) / n,
+          (b->io_.read_bytes_ - a->io_.read_bytes_) / 1024.0 / n,
+          (b->io_.writes_ - a->io_.writes_) / n,
+          (b->io_.write_bytes_ - a->io_.write_bytes_) / 1024.0 / n,
+          (b->io_.syncs_ - a->io_.syncs_) / n,
+          (b->io_.other_ - a->io_.other_) / n,
+          (b->io_.fetches_ - a->io_.fetches_) / n,
+          (b->io_.fetch_misses_ - a->io_.fetch_misses_) / n);
+  fprintf(stderr, "  Faults per op: %.3f major, %.3f minor; "
+          "latency p50 %.3f p99 %.3f micros\n",
+          (b->usage_.ru_majflt - a->usage_.ru_majflt) / n,
+          (b->usage_.ru_minflt - a->usage_.ru_minflt) / n,
+          last_result_.p50_, last_result_.p99_);
+}
+
+/* Print database size, free pages and throughput since the last interval. */
+static void print_interval_stats(void) {
+  double now = now_micros() * 1e-6;
+  long pages = get_pragma_int("page_count");
+  long freelist = get_pragma_int("freelist_count");
+  const char *db_file = sqlite3_db_filename(db_, "main");
+
+  fprintf(stderr, "  %10ld ops: %10.1f ops/sec; db %8.2f MB (file %8.2f MB); "
+          "freelist %8ld pages (%4.1f%%)\n",
+          done_, (done_ - last_interval_done_) / (now - last_interval_ + 1e-9),
+          (double)pages * page_size_ / 1048576.0,
+          file_size(db_file) / 1048576.0,
+          freelist, pages ? 100.0 * freelist / pages : 0.0);
+  last_interval_ = now;
+  last_interval_done_ = done_;
+}
+
+static void print_space_stats(void) {
+  long pages = get_pragma_int("page_count");
+  long freelist = get_pragma_int("freelist_count");
+
+  fprintf(stderr, "Space:      %.2f MB in %ld pages, freelist %ld pages "
+          "(%.1f%%), auto_vacuum %s\n",
+          (double)pages * page_size_ / 1048576.0, pages, freelist,
+          pages ? 100.0 * freelist / pages : 0.0,
+          FLAGS_auto_vacuum ? FLAGS_auto_vacuum : "NONE");
+}
+
 static void stmt_runonce(sqlite3_stmt *stmt) {
   int status;
 
@@ -285,6 +800,88 @@ static void stmt_clear_and_reset(sqlite3_stmt *stmt) {
   error_check(status);
 }
 
+/*
+ * --phase_stats splits each operation into phases. A phase ends where the
+ * next one starts, so the clock is read once per boundary. The histograms
+ * hold nanoseconds and are only fed by the benchmark thread.
+ */
+static const char *op_phase_names[kNumOpPhases] = {
+  "keygen", "valuegen", "bind", "step", "reset", "begin", "commit",
+  "  write", "  sync"
+};
+
+static inline uint64_t phase_start(void) {
+  return FLAGS_phase_stats ? now_nanos() : 0;
+}
+
+/* Charge the time since *t to phase and restart the clock. */
+static inline void phase_end(enum OpPhase phase, uint64_t *t) {
+  uint64_t now;
+
+  if (!FLAGS_phase_stats)
+    return;
+  now = now_nanos();
+  histogram_add(&phase_hist_[phase], now - *t);
+  *t = now;
+}
+
+static void txn_begin(void) {
+  uint64_t t = phase_start();
+
+  if (FLAGS_slow_op_us > 0)
+    slowop_txn_begin();
+  stmt_runonce(stmts[STMT_TSTART]);
+  phase_end(OP_BEGIN, &t);
+}
+
+/* COMMIT, split into time spent in VFS syncs and everything else. */
+static void txn_commit(void) {
+  IoStats io0, io1;
+  uint64_t t, nanos, sync;
+
+  if (!FLAGS_phase_stats) {
+    stmt_runonce(stmts[STMT_TEND]);
+    return;
+  }
+
+  iostat_get(&io0);
+  t = now_nanos();
+  stmt_runonce(stmts[STMT_TEND]);
+  nanos = now_nanos() - t;
+  iostat_get(&io1);
+
+  sync = io1.sync_nanos_ - io0.sync_nanos_;
+  if (sync > nanos)
+    sync = nanos;
+  histogram_add(&phase_hist_[OP_COMMIT], nanos);
+  histogram_add(&phase_hist_[OP_COMMIT_WRITE], nanos - sync);
+  histogram_add(&phase_hist_[OP_COMMIT_SYNC], sync);
+}
+
+static void print_phase_stats(void) {
+  double total = 0;
+  Histogram *h;
+  int p;
+
+  /* The commit write/sync rows are already part of commit. */
+  for (p = 0; p < kNumOpPhases; p++)
+    if (p != OP_COMMIT_WRITE && p != OP_COMMIT_SYNC)
+      total += phase_hist_[p].sum_;
+
+  fprintf(stderr, "  %-14s %10s %10s %10s %10s %7s\n", "phase (us)",
+          "count", "mean", "p50", "p99", "share");
+  for (p = 0; p < kNumOpPhases; p++) {
+    h = &phase_hist_[p];
+    if (h->num_ == 0)
+      continue;
+    fprintf(stderr, "  %-14s %10.0f %10.3f %10.3f %10.3f %6.1f%%\n",
+            op_phase_names[p], h->num_, h->sum_ / h->num_ / 1e3,
+            histogram_percentile(h, 50) / 1e3,
+            histogram_percentile(h, 99) / 1e3,
+            total > 0 ? 100.0 * h->sum_ / total : 0.0);
+  }
+}
+
 static void load_extension(void) {
   sqlite3 *tmpdb;
   char *err_msg;
@@ -385,13 +982,74 @@ static void benchmark_open_slos(void) {
 }
 
 
-static void benchmark_open() {
+/* Apply the configured pragmas, and the schema if create, to a new db_. */
+static void benchmark_configure(bool create) {
   char* err_msg = NULL;
   int status;
 
+  /* Set the size of the mmap region. */
+  set_pragma_int("mmap_size", (long)FLAGS_mmap_size_mb * 1024 * 1024);
+  if (get_pragma_int("mmap_size") < (long)FLAGS_mmap_size_mb * 1024 * 1024)
+    fprintf(stderr, "mmap_size capped at %ld bytes by SQLITE_MAX_MMAP_SIZE\n",
+            get_pragma_int("mmap_size"));
+
+  /* Change SQLite cache size */
+  set_pragma_int("cache_size", FLAGS_num_pages);
+
+  /* Where sorts, temp tables and automatic indexes spill to. */
+  if (FLAGS_temp_store != NULL)
+    set_pragma_str("temp_store", FLAGS_temp_store);
+
+  /* The page size must be set before the database is created. */
+  set_pragma_int("page_size", FLAGS_page_size);
+
+  /* auto_vacuum only takes effect while the database is still empty. */
+  if (FLAGS_auto_vacuum != NULL)
+    set_pragma_str("auto_vacuum", FLAGS_auto_vacuum);
+
+  /* Change journal mode to WAL if WAL enabled flag is on */
+  if (FLAGS_journal_mode != NULL) {
+    set_pragma_str("journal_mode", FLAGS_journal_mode);
+    FLAGS_WAL_enabled = !strcasecmp(FLAGS_journal_mode, "WAL");
+    if (FLAGS_WAL_enabled)
+      set_pragma_int("wal_autocheckpoint", FLAGS_checkpoint_granularity);
+  } else if (FLAGS_WAL_enabled) {
+    set_pragma_str("journal_mode", "WAL");
+    set_pragma_int("wal_autocheckpoint", FLAGS_checkpoint_granularity);
+  } else {
+    set_pragma_str("journal_mode", "OFF");
+  }
+  /*
+   * The slow-op tracer and the WAL timeline need to see WAL growth and
+   * checkpoints, so the wal hook takes over the autocheckpoint it replaces.
+   */
+  if (FLAGS_WAL_enabled &&
+      (FLAGS_slow_op_us > 0 || FLAGS_wal_timeline != NULL))
+    wal_hook_install(db_, FLAGS_checkpoint_granularity);
+
+  /*
+   * Set the locking mode and create tables/index for database. EXCLUSIVE
+   * keeps the WAL index in heap memory; NORMAL uses shared memory so that
+   * other connections can read while this one writes.
+   */
+  set_pragma_str("locking_mode", FLAGS_locking_mode);
+
+  key_init();
+  if (create) {
+    status = sqlite3_exec(db_, key_schema(), NULL, NULL, &err_msg);
+    exec_error_check(status, err_msg);
+  }
+  page_size_ = get_pragma_int("page_size");
+
+  stmt_prepare();
+}
+
+static void benchmark_open() {
   assert(db_ == NULL);
 
   db_num_++;
+  loaded_entries_ = 0;
+  lookup_depth_valid_ = false;
 
   /* Open the database. */
   if (FLAGS_oid > 0)
@@ -399,33 +1057,124 @@ static void benchmark_open() {
   else
     benchmark_open_regular();
 
-  /* Set the size of the mmap region. */
-  set_pragma_int("mmap_size", FLAGS_mmap_size_mb * 1024 * 1024);
+  benchmark_configure(true);
+}
 
-  /* Change SQLite cache size */
-  set_pragma_int("cache_size", FLAGS_num_pages);
+/*
+ * Close db_, evict the database and its WAL from the OS page cache and
+ * open it again with the same settings, for --cold.
+ */
+static void cold_reopen(void) {
+  const char *suffixes[] = { "", "-wal", "-journal" };
+  char path[1024], file_name[1100];
+  double t0, resident;
+  size_t i;
+  int status;
 
-  /* FLAGS_page_size is defaulted to 1024 */
-  if (FLAGS_page_size != 1024)
-    set_pragma_int("page_size", FLAGS_page_size);
+  snprintf(path, sizeof(path), "%s", sqlite3_db_filename(db_, "main"));
+  stmt_finalize();
+  json_finalize();
+  query_finalize();
+  status = sqlite3_close(db_);
+  error_check(status);
+  db_ = NULL;
 
-  /* Change journal mode to WAL if WAL enabled flag is on */
-  if (FLAGS_WAL_enabled) {
-    set_pragma_str("journal_mode", "WAL");
-    set_pragma_int("wal_autocheckpoint", FLAGS_checkpoint_granularity);
-  } else {
-    set_pragma_str("journal_mode", "OFF");
+  for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+    snprintf(file_name, sizeof(file_name), "%s%s", path, suffixes[i]);
+    resident = file_evict(file_name);
+    if (i == 0)
+      cold_.resident_ = resident;
   }
 
-  /* Change locking mode to exclusive and create tables/index for database */
-  set_pragma_str("locking_mode", "EXCLUSIVE");
+  t0 = now_micros() * 1e-6;
+  benchmark_open_regular();
+  benchmark_configure(false);
+  cold_.open_ = now_micros() * 1e-6 - t0;
+}
 
-  char* create_stmt =
-          "CREATE TABLE test (key blob, value blob, PRIMARY KEY (key))";
-  status = sqlite3_exec(db_, create_stmt, NULL, NULL, &err_msg);
-  exec_error_check(status, err_msg);
+/* Start tracing the warm-up curve of a run expected to take ops ops. */
+static void cold_start(long ops) {
+  memset(&cold_, 0, sizeof(cold_));
+  cold_reopen();
+  cold_.slice_ops_ = ops / kColdSlices > 0 ? ops / kColdSlices : 1;
+  cold_.watching_ = true;
+}
 
-  stmt_prepare();
+static void cold_print(void) {
+  double last = 0;
+  int i;
+
+  cold_.watching_ = false;
+  fprintf(stderr, "  cold       : reopen %.2f ms, %.1f%% of db cached, "
+          "first result %.1f micros\n", cold_.open_ * 1e3,
+          cold_.resident_ * 100, cold_.first_ * 1e6);
+  fprintf(stderr, "  warm-up    : ops/sec per tenth of the run:");
+  for (i = 0; i < cold_.slices_; i++) {
+    fprintf(stderr, " %.0f", cold_.ends_[i] > last ?
+            cold_.slice_ops_ / (cold_.ends_[i] - last) : 0.0);
+    last = cold_.ends_[i];
+  }
+  fprintf(stderr, "\n");
+}
+
+static void backup_copy(sqlite3 *dst, sqlite3 *src) {
+  sqlite3_backup *backup;
+  int status;
+
+  backup = sqlite3_backup_init(dst, "main", src, "main");
+  if (backup == NULL) {
+    fprintf(stderr, "backup error: %s\n", sqlite3_errmsg(dst));
+    exit(1);
+  }
+  status = sqlite3_backup_step(backup, -1);
+  if (status != SQLITE_DONE) {
+    fprintf(stderr, "backup step error: status = %d\n", status);
+    exit(1);
+  }
+  status = sqlite3_backup_finish(backup);
+  error_check(status);
+}
+
+/*
+ * Save the database so that every repetition of a benchmark
+ * starts from the same state.
+ */
+static void snapshot_save(void) {
+  char file_name[100];
+  char *err_msg = NULL;
+  int status;
+
+  if (snap_db_ == NULL) {
+    snprintf(file_name, sizeof(file_name),
+		    "/tmp/dbbench_sqlite3-%d.snap", db_num_);
+    status = sqlite3_open(file_name, &snap_db_);
+    if (status) {
+      fprintf(stderr, "open error: %s\n", sqlite3_errmsg(snap_db_));
+      exit(1);
+    }
+    status = sqlite3_exec(snap_db_, "PRAGMA journal_mode = OFF; "
+                          "PRAGMA synchronous = OFF", NULL, NULL, &err_msg);
+    exec_error_check(status, err_msg);
+  }
+
+  backup_copy(snap_db_, db_);
+}
+
+static void snapshot_restore(void) {
+  backup_copy(db_, snap_db_);
+  lookup_depth_valid_ = false;
+}
+
+static void snapshot_close(void) {
+  char file_name[100];
+
+  if (snap_db_ == NULL)
+    return;
+
+  snprintf(file_name, sizeof(file_name), "%s", sqlite3_db_filename(snap_db_, "main"));
+  sqlite3_close(snap_db_);
+  snap_db_ = NULL;
+  remove(file_name);
 }
 
 /* 
@@ -433,26 +1182,41 @@ static void benchmark_open() {
  *  but does do benchmark-related bookkeeping because it 
  *  is used to load the database beforehand.
  */
-static void benchmark_prefill(int value_size, int entries) {
+static void load_rows(int value_size, long entries) {
+  const char *db_file = sqlite3_db_filename(db_, "main");
+  double begin = now_micros() * 1e-6;
+  double last = begin, now;
   char key[100];
-  char *value;
+  const char *value;
   int status;
-  int j, k;
+  long j, k;
 
   sqlite3_stmt *replace_stmt = stmts[STMT_REPLACE];
 
   stmt_runonce(stmts[STMT_TSTART]);
   /* Create and execute SQL statements */
   for (j = 0; j < entries; j++) {
+    /* Commit in pieces so the WAL does not grow to the size of the table. */
+    if (j > 0 && j % kLoadTxnRows == 0) {
+      stmt_runonce(stmts[STMT_TEND]);
+      stmt_runonce(stmts[STMT_TSTART]);
+      now = now_micros() * 1e-6;
+      if (now - last >= kLoadProgressSecs) {
+        fprintf(stderr, "  loaded %ld of %ld rows (%.1f%%), %.0f rows/s, "
+                "db %.1f MB, %.0f s left\n", j, entries, 100.0 * j / entries,
+                j / (now - begin), file_size(db_file) / 1048576.0,
+                (entries - j) * (now - begin) / j);
+        last = now;
+      }
+    }
+
     value = rand_gen_generate(&gen_, value_size);
 
     /* Create values for key-value pair */
     k = j;
-    snprintf(key, sizeof(key), "%016d", k);
 
     /* Bind KV values into replace_stmt */
-    status = sqlite3_bind_blob(replace_stmt, 1, key, 16, SQLITE_STATIC);
-    error_check(status);
+    bind_key(replace_stmt, 1, key, k);
     status = sqlite3_bind_blob(replace_stmt, 2, value,
                                 value_size, SQLITE_STATIC);
     error_check(status);
@@ -465,172 +1229,794 @@ static void benchmark_prefill(int value_size, int entries) {
   }
 
   stmt_runonce(stmts[STMT_TEND]);
+  if (value_size != loaded_value_size_ || entries > loaded_entries_)
+    loaded_entries_ = entries;
+  loaded_value_size_ = value_size;
+  lookup_depth_valid_ = false;
 }
 
-static void benchmark_writebatch(int iter, int order, long num_ops, int num_entries, 
-		int value_size, int entries_per_batch) {
+/* Skip the load if the same rows are still in place from the last one. */
+static void benchmark_prefill(int value_size, long entries) {
+  if (entries == 0 ||
+      (entries <= loaded_entries_ && value_size == loaded_value_size_))
+    return;
+  load_rows(value_size, entries);
+}
+
+static void benchmark_writebatch(long iter, int order, long num_ops, long num_entries, 
+		ValueSizeDist *dist, int entries_per_batch) {
 
   char key[100];
-  char *value;
+  const char *value;
+  uint64_t t0 = 0, tp;
+  int value_size;
   int status;
-  int j, k;
+  int j;
+  long k;
 
   sqlite3_stmt *replace_stmt = stmts[STMT_REPLACE];
   /* Create and execute SQL statements */
   for (j = 0; j < entries_per_batch; j++) {
+    tp = phase_start();
+    value_size = value_dist_next(dist, &rand_);
     value = rand_gen_generate(&gen_, value_size);
+    phase_end(OP_VALUEGEN, &tp);
 
     /* Create values for key-value pair */
-    k = (order == SEQUENTIAL) ? ((iter + j) % num_entries) :
-                  (rand_next(&rand_) % num_entries);
-    snprintf(key, sizeof(key), "%016d", k);
+    if (order == SEQUENTIAL)
+      k = (iter + j) % num_entries;
+    else if (FLAGS_unique_keys)
+      k = perm_at(&perm_, iter + j);
+    else
+      k = rand_key(&rand_, num_entries);
+    phase_end(OP_KEYGEN, &tp);
 
     /* Bind KV values into replace_stmt */
-    status = sqlite3_bind_blob(replace_stmt, 1, key, 16, SQLITE_STATIC);
-    error_check(status);
+    bind_key(replace_stmt, 1, key, k);
     status = sqlite3_bind_blob(replace_stmt, 2, value,
                                 value_size, SQLITE_STATIC);
     error_check(status);
+    phase_end(OP_BIND, &tp);
 
     /* Execute replace_stmt */
-    bytes_ += value_size + strlen(key);
+    bytes_ += value_size + key_size();
+    if (track_sizes_)
+      t0 = now_nanos();
     status = sqlite3_step(replace_stmt);
     step_error_check(status);
+    phase_end(OP_STEP, &tp);
 
     stmt_clear_and_reset(replace_stmt);
+    phase_end(OP_RESET, &tp);
+    if (track_sizes_)
+      record_size_class(key_size(), value_size, now_nanos() - t0);
 
     if (FLAGS_benchmark_single_op)
     	finished_single_op(WRITE);
   }
 }
 
-void warn_ops(int num_entries) {
+void warn_ops(long num_entries) {
   if (num_entries != num_ops_) {
     char* msg = malloc(sizeof(char) * 100);
-    snprintf(msg, 100, "(%d ops)", num_entries);
+    snprintf(msg, 100, "(%ld ops)", num_entries);
     message_ = msg;
   }
 }
 
-static void benchmark_write(int order, long num_ops, int num_entries, int value_size,
-	int entries_per_batch) {
+static void benchmark_write(int order, long num_ops, long num_entries,
+	ValueSizeDist *dist, int entries_per_batch) {
   const bool transaction = FLAGS_transaction;
-  int i;
+  long i;
 
   warn_ops(num_entries);
 
-  sqlite3_stmt *begin_trans_stmt = stmts[STMT_TSTART];
-  sqlite3_stmt *end_trans_stmt = stmts[STMT_TEND];
-
-  for (i = 0; i < num_ops; i += entries_per_batch) {
+  for (i = 0; i < num_ops && !time_up(); i += entries_per_batch) {
     /* Begin write transaction */
     if (transaction)
-      stmt_runonce(begin_trans_stmt);
+      txn_begin();
 
-    benchmark_writebatch(i, order, num_ops, num_entries, value_size, entries_per_batch);
+    benchmark_writebatch(i, order, num_ops, num_entries, dist, entries_per_batch);
 
     /* End write transaction */
     if (transaction)
-      stmt_runonce(end_trans_stmt);
+      txn_commit();
 
     if (!FLAGS_benchmark_single_op)
     	finished_single_op(WRITE);
   }
 }
 
-static void benchmark_readbatch(int iter, int order, int entries_per_batch)
+/* Build the table of num_entries rows in key order, timed. */
+static void benchmark_load(long num_entries) {
+  warn_ops(num_entries);
+  load_rows(FLAGS_value_size, num_entries);
+  bytes_ += num_entries * (key_size() + FLAGS_value_size);
+  done_ = num_entries;
+}
+
+static void benchmark_readbatch(long iter, int order, long num_entries,
+	int entries_per_batch)
 {
   sqlite3_stmt *read_stmt = stmts[STMT_READ];
   char key[100];
+  uint64_t t0 = 0, tp;
+  int value_size = 0;
   int status;
-  int j, k;
+  int j;
+  long k;
 
   /* Create and execute SQL statements */
   for (j = 0; j < entries_per_batch; j++) {
     /* Create key value */
-    k = (order == SEQUENTIAL) ? (iter + j) % num_keys_ : 
-	    (rand_next(&rand_) % num_keys_);
-    snprintf(key, sizeof(key), "%016d", k);
+    tp = phase_start();
+    k = (order == SEQUENTIAL) ? (iter + j) % num_entries : 
+	    rand_key(&rand_, num_entries);
+    phase_end(OP_KEYGEN, &tp);
 
     /* Bind key value into read_stmt */
-    status = sqlite3_bind_blob(read_stmt, 1, key, 16, SQLITE_STATIC);
-    error_check(status);
+    bind_key(read_stmt, 1, key, k);
+    phase_end(OP_BIND, &tp);
     
     /* Execute read statement */
-    while ((status = sqlite3_step(read_stmt)) == SQLITE_ROW) {}
+    value_size = 0;
+    if (track_sizes_)
+      t0 = now_nanos();
+    while ((status = sqlite3_step(read_stmt)) == SQLITE_ROW) {
+      if (track_sizes_)
+        value_size = sqlite3_column_bytes(read_stmt, 1);
+    }
     step_error_check(status);
+    phase_end(OP_STEP, &tp);
 
     /* Reset SQLite statement for another use */
     stmt_clear_and_reset(read_stmt);
+    phase_end(OP_RESET, &tp);
+    if (track_sizes_)
+      record_size_class(key_size(), value_size, now_nanos() - t0);
 
     if (FLAGS_benchmark_single_op)
     	finished_single_op(READ);
   }
 }
 
-static void benchmark_read(int order, int entries_per_batch) {
+static void benchmark_read(int order, long num_reads, long num_entries,
+	int entries_per_batch) {
   bool transaction = FLAGS_transaction && (entries_per_batch > 1);
-  int i;
-
-  sqlite3_stmt *begin_trans_stmt = stmts[STMT_TSTART];
-  sqlite3_stmt *end_trans_stmt = stmts[STMT_TEND];
+  long i;
 
-  for (i = 0; i < reads_; i += entries_per_batch) {
+  for (i = 0; i < num_reads && !time_up(); i += entries_per_batch) {
     /* Begin read transaction */
     if (transaction)
-      stmt_runonce(begin_trans_stmt);
+      txn_begin();
 
-    benchmark_readbatch(i, order, entries_per_batch);
+    benchmark_readbatch(i, order, num_entries, entries_per_batch);
 
     /* End read transaction */
     if (transaction)
-      stmt_runonce(end_trans_stmt);
+      txn_commit();
 
     if (!FLAGS_benchmark_single_op)
     	finished_single_op(READ);
   }
 }
 
-static void benchmark_readwrite(int order, long num_ops, int num_entries, int value_size,
-	int entries_per_batch, int write_percent) {
+/*
+ * Random point reads that record, for each lookup, whether it missed
+ * SQLite's page cache (pages read through xRead), needed a page outside
+ * the mmap region (an xFetch that fell back to a read) or took a major
+ * page fault on a mapped page that was not resident.
+ */
+static void benchmark_read_miss(long num_reads, long num_entries) {
+  sqlite3_stmt *read_stmt = stmts[STMT_READ];
+  struct rusage ru0, ru1;
+  IoStats io0, io1;
+  int miss0, miss1, hi;
+  uint64_t t0, nanos;
+  bool missed;
+  char key[100];
+  int status;
+  long i;
+
+  if (!miss_active_) {
+    memset(&miss_, 0, sizeof(miss_));
+    histogram_clear(&miss_.hit_);
+    histogram_clear(&miss_.miss_);
+    miss_active_ = true;
+  }
+  for (i = 0; i < num_reads && !time_up(); i++) {
+    bind_key(read_stmt, 1, key, rand_key(&rand_, num_entries));
+
+    sqlite3_db_status(db_, SQLITE_DBSTATUS_CACHE_MISS, &miss0, &hi, 0);
+    iostat_get(&io0);
+    getrusage(RUSAGE_SELF, &ru0);
+    t0 = now_nanos();
+    while ((status = sqlite3_step(read_stmt)) == SQLITE_ROW)
+      ;
+    step_error_check(status);
+    stmt_clear_and_reset(read_stmt);
+    nanos = now_nanos() - t0;
+    getrusage(RUSAGE_SELF, &ru1);
+    iostat_get(&io1);
+    sqlite3_db_status(db_, SQLITE_DBSTATUS_CACHE_MISS, &miss1, &hi, 0);
+
+    missed = false;
+    miss_.lookups_++;
+    if (miss1 != miss0) {
+      miss_.cache_lookups_++;
+      miss_.cache_pages_ += (unsigned)(miss1 - miss0);
+      missed = true;
+    }
+    if (io1.fetch_misses_ != io0.fetch_misses_)
+      miss_.map_lookups_++;
+    if (ru1.ru_majflt != ru0.ru_majflt) {
+      miss_.fault_lookups_++;
+      missed = true;
+    }
+    histogram_add(missed ? &miss_.miss_ : &miss_.hit_, nanos / 1e3);
+    finished_single_op(READ);
+  }
+}
+
+/* Bind and step the docs statement for one JSON operation on key k. */
+static void json_op(int type, long k, ValueSizeDist *dist) {
+  sqlite3_stmt *stmt;
+  const char *doc;
+  int len, status;
+
+  switch (type) {
+  case BENCH_JSON_FILL:
+    stmt = json_stmt(db_, JSON_INSERT);
+    doc = json_generate(&rand_, k, value_dist_next(dist, &rand_), &len);
+    sqlite3_bind_int64(stmt, 1, k);
+    status = sqlite3_bind_text(stmt, 2, doc, len, SQLITE_STATIC);
+    error_check(status);
+    bytes_ += len + 8;
+    break;
+  case BENCH_JSON_READ:
+    stmt = json_stmt(db_, JSON_LOOKUP);
+    sqlite3_bind_int64(stmt, 1, k);
+    break;
+  default:
+    stmt = json_stmt(db_, JSON_UPDATE);
+    sqlite3_bind_int64(stmt, 1, rand_next(&rand_));
+    sqlite3_bind_int64(stmt, 2, k);
+    bytes_ += 16;
+    break;
+  }
+
+  while ((status = sqlite3_step(stmt)) == SQLITE_ROW)
+    bytes_ += sqlite3_column_bytes(stmt, 0);
+  step_error_check(status);
+  stmt_clear_and_reset(stmt);
+}
+
+/*
+ * JSON documents in the docs table (see json.c): write whole documents,
+ * look them up by a nested path through its index, or set one field.
+ */
+static void benchmark_json(int type, int order, long num_ops,
+                           long num_entries, ValueSizeDist *dist,
+                           int entries_per_batch) {
+  bool transaction = FLAGS_transaction && type != BENCH_JSON_READ;
+  long i, j, k;
+
+  for (i = 0; i < num_ops && !time_up(); i += entries_per_batch) {
+    if (transaction)
+      txn_begin();
+
+    for (j = i; j < i + entries_per_batch; j++) {
+      k = (order == SEQUENTIAL) ? j % num_entries :
+                                  rand_key(&rand_, num_entries);
+      json_op(type, k, dist);
+    }
+
+    if (transaction)
+      txn_commit();
+
+    finished_single_op(type == BENCH_JSON_READ ? READ : WRITE);
+  }
+}
+
+/*
+ * Set up the docs table: jsonfill starts from an empty one, the others
+ * need all num_entries documents. False if the storage is unsupported.
+ */
+static bool json_prefill(Workload *w) {
+  long k;
+
+  if (!json_init()) {
+    fprintf(stderr, "%-12s : skipped, JSONB needs SQLite 3.45.0 or later\n",
+            w->name_);
+    return false;
+  }
+  if (w->type_ != BENCH_JSON_FILL && json_count(db_) >= w->num_entries_)
+    return true;
+
+  json_create(db_);
+  if (w->type_ == BENCH_JSON_FILL)
+    return true;
+  stmt_runonce(stmts[STMT_TSTART]);
+  for (k = 0; k < w->num_entries_; k++) {
+    if (k > 0 && k % kLoadTxnRows == 0) {
+      stmt_runonce(stmts[STMT_TEND]);
+      stmt_runonce(stmts[STMT_TSTART]);
+    }
+    json_op(BENCH_JSON_FILL, k, w->dist_);
+  }
+  stmt_runonce(stmts[STMT_TEND]);
+  bytes_ = 0;
+
+  return true;
+}
+
+/* Random start of a range of query_rows keys; returns its length. */
+static long query_range(sqlite3_stmt *stmt, int idx, char *lo, char *hi,
+                        long num_entries) {
+  long rows = FLAGS_query_rows < num_entries ? FLAGS_query_rows : num_entries;
+  long k = rand_key(&rand_, num_entries - rows + 1);
+
+  bind_key(stmt, idx, lo, k);
+  bind_key(stmt, idx + 1, hi, k + rows);
+
+  return rows;
+}
+
+/*
+ * Analytic queries (see query.c) over random ranges of query_rows keys.
+ * An op is one query; stop() reports the rows processed per second and
+ * the sorts, automatic indexes and temp file traffic per query, summed
+ * over every pass since start().
+ */
+static void benchmark_query(int type, long num_queries, long num_entries) {
+  sqlite3_stmt *stmt = query_stmt(db_, type);
+  char lo[100], hi[100], lo2[100], hi2[100];
+  int status, i;
+  long q;
+
+  if (query_type_ != type) {
+    query_stats_start(&query_, stmt);
+    query_type_ = type;
+  }
+  for (q = 0; q < num_queries && !time_up(); q++) {
+    query_.rows_ += query_range(stmt, 1, lo, hi, num_entries);
+    if (type == QUERY_TOPN)
+      sqlite3_bind_int(stmt, 3, FLAGS_query_limit);
+    else if (type == QUERY_JOIN)
+      query_.rows_ += query_range(stmt, 3, lo2, hi2, num_entries);
+
+    while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+      for (i = 0; i < sqlite3_column_count(stmt); i++)
+        bytes_ += sqlite3_column_bytes(stmt, i);
+      query_.result_rows_++;
+    }
+    step_error_check(status);
+    stmt_clear_and_reset(stmt);
+
+    finished_single_op(READ);
+  }
+  query_.queries_ += q;
+}
+
+/* Range scans of scan_length rows starting at sequential or random keys. */
+static void benchmark_scan(int order, long num_scans, long num_entries,
+	int scan_length) {
+  sqlite3_stmt *scan_stmt = stmts[STMT_SCAN];
+  char key[100];
+  long rows = 0;
+  int status;
+  long i, k;
+
+  for (i = 0; i < num_scans && !time_up(); i++) {
+    k = (order == SEQUENTIAL) ? (i * scan_length) % num_entries :
+                                rand_key(&rand_, num_entries);
+    bind_key(scan_stmt, 1, key, k);
+    status = sqlite3_bind_int(scan_stmt, 2, scan_length);
+    error_check(status);
+
+    while ((status = sqlite3_step(scan_stmt)) == SQLITE_ROW) {
+      bytes_ += sqlite3_column_bytes(scan_stmt, 0) +
+                sqlite3_column_bytes(scan_stmt, 1);
+      rows++;
+    }
+    step_error_check(status);
+    stmt_clear_and_reset(scan_stmt);
+
+    finished_single_op(READ);
+  }
+  num_scans = i;
+
+  message_ = malloc(sizeof(char) * 100);
+  snprintf(message_, 100, "(%.1f rows/scan)", num_scans ? (double)rows / num_scans : 0.0);
+}
+
+static sqlite3_int64 lookup_rowid(char *key, long k) {
+  sqlite3_stmt *stmt = stmts[STMT_ROWID];
+  sqlite3_int64 rowid;
+  int status;
+
+  /* With INTEGER PRIMARY KEY the key is the rowid. */
+  if (key_layout() == LAYOUT_INTEGER_PK)
+    return k;
+
+  bind_key(stmt, 1, key, k);
+  status = sqlite3_step(stmt);
+  if (status != SQLITE_ROW) {
+    fprintf(stderr, "key %ld not found\n", k);
+    exit(1);
+  }
+  rowid = sqlite3_column_int64(stmt, 0);
+  stmt_clear_and_reset(stmt);
+
+  return rowid;
+}
+
+/*
+ * Read or write io_size bytes at a random offset of a random value, either
+ * through an incremental blob handle or through the whole-row path. For
+ * reads the blob handle stays open and moves between rows with
+ * sqlite3_blob_reopen; writes open and close it inside each transaction.
+ */
+static void benchmark_range(int type, long num_ops, long num_entries,
+	int value_size) {
+  bool write = (type == BENCH_BLOB_WRITE || type == BENCH_ROW_WRITE);
+  bool blob_api = (type == BENCH_BLOB_READ || type == BENCH_BLOB_WRITE);
+  int io_size = FLAGS_blob_io_size;
+  sqlite3_stmt *value_stmt = stmts[STMT_VALUE];
+  sqlite3_stmt *update_stmt = stmts[STMT_UPDATE];
+  sqlite3_blob *blob = NULL;
+  uint64_t alloc0 = alloc_bytes();
+  uint64_t copied = 0;
+  sqlite3_int64 rowid;
+  uint64_t t0 = 0;
+  const char *row;
+  const char *patch;
+  char *buf;
+  char key[100];
+  int offset, len;
+  long k;
+  int status;
+  long i;
+
+  if (io_size > value_size)
+    io_size = value_size;
+  buf = malloc(value_size > 0 ? value_size : 1);
+
+  for (i = 0; i < num_ops && !time_up(); i++) {
+    k = rand_key(&rand_, num_entries);
+    offset = rand_uniform(&rand_, value_size - io_size + 1);
+    if (track_sizes_)
+      t0 = now_nanos();
+    if (write)
+      stmt_runonce(stmts[STMT_TSTART]);
+
+    if (blob_api) {
+      rowid = lookup_rowid(key, k);
+      if (blob == NULL)
+        status = sqlite3_blob_open(db_, "main", "test", "value", rowid, write,
+                                   &blob);
+      else
+        status = sqlite3_blob_reopen(blob, rowid);
+      error_check(status);
+
+      if (write) {
+        patch = rand_gen_generate(&gen_, io_size);
+        status = sqlite3_blob_write(blob, patch, io_size, offset);
+        error_check(status);
+        /* An open blob handle keeps COMMIT from completing. */
+        status = sqlite3_blob_close(blob);
+        blob = NULL;
+      } else {
+        status = sqlite3_blob_read(blob, buf, io_size, offset);
+      }
+      error_check(status);
+      copied += io_size;
+    } else {
+      bind_key(value_stmt, 1, key, k);
+      status = sqlite3_step(value_stmt);
+      if (status != SQLITE_ROW) {
+        fprintf(stderr, "key %ld not found\n", k);
+        exit(1);
+      }
+      row = sqlite3_column_blob(value_stmt, 0);
+      len = sqlite3_column_bytes(value_stmt, 0);
+      if (write) {
+        /* Patch a private copy of the whole value and write it back. */
+        memcpy(buf, row, len);
+        patch = rand_gen_generate(&gen_, io_size);
+        memcpy(buf + offset, patch, io_size);
+        copied += len;
+      } else {
+        memcpy(buf, row + offset, io_size);
+        copied += io_size;
+      }
+      stmt_clear_and_reset(value_stmt);
+
+      if (write) {
+        status = sqlite3_bind_blob(update_stmt, 1, buf, len, SQLITE_STATIC);
+        error_check(status);
+        bind_key(update_stmt, 2, key, k);
+        status = sqlite3_step(update_stmt);
+        step_error_check(status);
+        stmt_clear_and_reset(update_stmt);
+      }
+    }
+
+    if (write)
+      stmt_runonce(stmts[STMT_TEND]);
+    if (track_sizes_)
+      record_size_class(key_size(), value_size, now_nanos() - t0);
+    bytes_ += io_size;
+    finished_single_op(write ? WRITE : READ);
+  }
+
+  sqlite3_blob_close(blob);
+  free(buf);
+  num_ops = i;
+
+  message_ = malloc(sizeof(char) * 100);
+  snprintf(message_, 100, "(%.1f KB alloc/op, %.1f KB copied/op)",
+           num_ops ? (alloc_bytes() - alloc0) / 1024.0 / num_ops : 0.0,
+           num_ops ? copied / 1024.0 / num_ops : 0.0);
+}
+
+static void benchmark_readwrite(int order, long num_ops, long num_entries,
+	ValueSizeDist *dist, int entries_per_batch, int write_percent) {
   bool transaction = FLAGS_transaction;
   enum OpKind kind;
-  int i;
+  long i;
 
   warn_ops(num_entries);
 
-  sqlite3_stmt *begin_trans_stmt = stmts[STMT_TSTART];
-  sqlite3_stmt *end_trans_stmt = stmts[STMT_TEND];
-
-  for (i = 0; i < num_ops; i += entries_per_batch) {
+  for (i = 0; i < num_ops && !time_up(); i += entries_per_batch) {
     /* Begin write transaction */
     if (transaction)
-      stmt_runonce(begin_trans_stmt);
+      txn_begin();
 
     kind = rand_uniform(&rand_, 100) < write_percent;
     if (kind == WRITE)
-    	benchmark_writebatch(i, order, num_ops, num_entries, value_size, entries_per_batch);
+    	benchmark_writebatch(i, order, num_ops, num_entries, dist, entries_per_batch);
     else
-    	benchmark_readbatch(i, order, entries_per_batch);
+    	benchmark_readbatch(i, order, num_entries, entries_per_batch);
 
     /* End write transaction */
     if (transaction)
-      stmt_runonce(end_trans_stmt);
+      txn_commit();
 
     if (!FLAGS_benchmark_single_op)
     	finished_single_op(kind);
   }
 }
 
+static void run_incremental_vacuum(void) {
+  if (FLAGS_incremental_vacuum_pages > 0)
+    set_pragma_int("incremental_vacuum", FLAGS_incremental_vacuum_pages);
+  else
+    set_pragma_str("incremental_vacuum", "0");
+}
+
+/*
+ * Update, delete and churn benchmarks. Updates rewrite existing rows in
+ * place, deletes remove each row once, and churn deletes one live row and
+ * inserts a new one per operation so the table stays at num_entries rows.
+ * Sequential churn retires the oldest key; random churn keeps the live
+ * and retired keys in one array and swaps a random pair each time.
+ * The key order and the op count live in the Workload, so warm-up,
+ * steady-state and --duration passes carry on where the last one left
+ * the table.
+ */
+static void benchmark_mutate(Workload *w, long num_ops) {
+  bool transaction = FLAGS_transaction;
+  int type = w->type_, order = w->order_;
+  int entries_per_batch = w->batch_size_;
+  long num_entries = w->num_entries_;
+  ValueSizeDist *dist = w->dist_;
+  sqlite3_stmt *stmt;
+  char key[100];
+  const char *value;
+  long *keys;
+  uint64_t tp;
+  int value_size;
+  int status;
+  long i, j;
+  long k, d, tmp;
+
+  if (order == RANDOM && type != BENCH_UPDATE && w->keys_ == NULL) {
+    if (type == BENCH_DELETE) {
+      w->keys_ = malloc(sizeof(long) * num_entries);
+      for (k = 0; k < num_entries; k++)
+        w->keys_[k] = k;
+      for (k = num_entries - 1; k > 0; k--) {
+        d = rand_key(&rand_, k + 1);
+        tmp = w->keys_[k];
+        w->keys_[k] = w->keys_[d];
+        w->keys_[d] = tmp;
+      }
+    } else {
+      /* Live keys are keys[0, num_entries), retired ones follow. */
+      w->keys_ = malloc(sizeof(long) * 2 * num_entries);
+      for (k = 0; k < 2 * num_entries; k++)
+        w->keys_[k] = k;
+    }
+  }
+  keys = w->keys_;
+
+  for (i = 0; i < num_ops && !time_up(); i += entries_per_batch) {
+    if (transaction)
+      txn_begin();
+
+    for (j = w->mutated_ + i; j < w->mutated_ + i + entries_per_batch; j++) {
+      switch (type) {
+      case BENCH_UPDATE:
+        tp = phase_start();
+        k = (order == SEQUENTIAL) ? j % num_entries :
+                                    rand_key(&rand_, num_entries);
+        phase_end(OP_KEYGEN, &tp);
+        value_size = value_dist_next(dist, &rand_);
+        value = rand_gen_generate(&gen_, value_size);
+        phase_end(OP_VALUEGEN, &tp);
+        stmt = stmts[STMT_UPDATE];
+        status = sqlite3_bind_blob(stmt, 1, value, value_size, SQLITE_STATIC);
+        error_check(status);
+        bind_key(stmt, 2, key, k);
+        phase_end(OP_BIND, &tp);
+        status = sqlite3_step(stmt);
+        step_error_check(status);
+        phase_end(OP_STEP, &tp);
+        stmt_clear_and_reset(stmt);
+        phase_end(OP_RESET, &tp);
+        bytes_ += value_size + key_size();
+        break;
+
+      case BENCH_DELETE:
+        tp = phase_start();
+        k = (keys != NULL) ? keys[j % num_entries] : j % num_entries;
+        phase_end(OP_KEYGEN, &tp);
+        stmt = stmts[STMT_DELETE];
+        bind_key(stmt, 1, key, k);
+        phase_end(OP_BIND, &tp);
+        status = sqlite3_step(stmt);
+        step_error_check(status);
+        phase_end(OP_STEP, &tp);
+        stmt_clear_and_reset(stmt);
+        phase_end(OP_RESET, &tp);
+        break;
+
+      /* Both statements of a churn op feed the same phases. */
+      case BENCH_CHURN:
+        tp = phase_start();
+        if (keys != NULL) {
+          d = rand_key(&rand_, num_entries);
+          k = num_entries + rand_key(&rand_, num_entries);
+          tmp = keys[d];
+          keys[d] = keys[k];
+          keys[k] = tmp;
+          k = keys[k];
+        } else {
+          k = j;
+        }
+        phase_end(OP_KEYGEN, &tp);
+        stmt = stmts[STMT_DELETE];
+        bind_key(stmt, 1, key, k);
+        phase_end(OP_BIND, &tp);
+        status = sqlite3_step(stmt);
+        step_error_check(status);
+        phase_end(OP_STEP, &tp);
+        stmt_clear_and_reset(stmt);
+        phase_end(OP_RESET, &tp);
+
+        k = (keys != NULL) ? keys[d] : j + num_entries;
+        phase_end(OP_KEYGEN, &tp);
+        value_size = value_dist_next(dist, &rand_);
+        value = rand_gen_generate(&gen_, value_size);
+        phase_end(OP_VALUEGEN, &tp);
+        stmt = stmts[STMT_REPLACE];
+        bind_key(stmt, 1, key, k);
+        status = sqlite3_bind_blob(stmt, 2, value, value_size, SQLITE_STATIC);
+        error_check(status);
+        phase_end(OP_BIND, &tp);
+        status = sqlite3_step(stmt);
+        step_error_check(status);
+        phase_end(OP_STEP, &tp);
+        stmt_clear_and_reset(stmt);
+        phase_end(OP_RESET, &tp);
+        bytes_ += value_size + key_size();
+        break;
+      }
+
+      if (FLAGS_benchmark_single_op)
+        finished_single_op(WRITE);
+    }
+
+    if (transaction)
+      txn_commit();
+
+    if (!FLAGS_benchmark_single_op)
+      finished_single_op(WRITE);
+
+    /* Reclaim free pages every FLAGS_incremental_vacuum_interval ops. */
+    if (FLAGS_incremental_vacuum_interval > 0 &&
+        (i + entries_per_batch) / FLAGS_incremental_vacuum_interval !=
+        i / FLAGS_incremental_vacuum_interval)
+      run_incremental_vacuum();
+  }
+  w->mutated_ += i;
+}
+
+/* Forget the key order once the table it describes is gone. */
+static void workload_reset_keys(Workload *w) {
+  free(w->keys_);
+  w->keys_ = NULL;
+  w->mutated_ = 0;
+}
+
+/*
+ * The counting VFS sits under every call SQLite makes to the OS, so it
+ * is only installed for the options and benchmarks that report from it.
+ */
+static bool needs_iostat(void) {
+  const char *prefixes[] = { "readrandommiss", "query", "groupcommit" };
+  const char *p = FLAGS_benchmarks;
+  size_t i, len;
+
+  if (FLAGS_io_stats || FLAGS_mmap_compare || FLAGS_madvise != NULL ||
+      FLAGS_phase_stats || FLAGS_slow_op_us > 0 ||
+      FLAGS_export_socket != NULL)
+    return true;
+
+  while (p != NULL && *p) {
+    len = strcspn(p, ",");
+    for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+      if (len >= strlen(prefixes[i]) &&
+          !strncmp(p, prefixes[i], strlen(prefixes[i])))
+        return true;
+    p += len + (p[len] == ',');
+  }
+
+  return false;
+}
+
 void benchmark_init() {
+  /* Place this thread and its memory before anything is allocated. */
+  affinity_init();
   db_ = NULL;
   db_num_ = 0;
   num_keys_ = FLAGS_num_keys;
   num_ops_ = FLAGS_num_ops;
   reads_ = FLAGS_reads < 0 ? FLAGS_num_ops : FLAGS_reads;
   bytes_ = 0;
+  track_latency_ = FLAGS_repetitions > 1 || FLAGS_cv_threshold > 0 ||
+                   FLAGS_sweep != NULL || FLAGS_json != NULL ||
+                   FLAGS_io_stats || FLAGS_mmap_compare ||
+                   FLAGS_export_socket != NULL || FLAGS_slow_op_us > 0;
+  snap_db_ = NULL;
+  results_ = NULL;
+  num_results_ = 0;
+  header_printed_ = false;
   rand_gen_init(&gen_, FLAGS_compression_ratio);
-  rand_init(&rand_, 301);;
+  rand_select(FLAGS_rng);
+  rand_seed(&rand_, 301, 0);
+  key_init();
+  /* Size the table relative to physical memory. */
+  if (FLAGS_dataset_ram_ratio > 0) {
+    num_keys_ = (long)(FLAGS_dataset_ram_ratio * phys_mem_bytes() /
+                       (key_size() + FLAGS_value_size));
+    FLAGS_num_keys = num_keys_;
+  }
+  alloc_init();
+  memstat_init();
+  if (needs_iostat())
+    iostat_init(FLAGS_madvise);
+  export_init(FLAGS_export_socket);
+  if (FLAGS_slow_op_us > 0)
+    slowop_open(FLAGS_slow_op_log);
+  if (FLAGS_wal_timeline != NULL)
+    wal_timeline_open(FLAGS_wal_timeline);
+  if (!value_dist_init(&value_dist_, FLAGS_value_size_dist, FLAGS_value_size)) {
+    fprintf(stderr, "invalid value size distribution '%s'\n",
+            FLAGS_value_size_dist);
+    exit(1);
+  }
 
   struct dirent* ep;
   DIR* test_dir = opendir(FLAGS_db);
@@ -650,9 +2036,69 @@ void benchmark_init() {
 void benchmark_fini() {
   int status;
 
+  snapshot_close();
+
   stmt_finalize();
+  json_finalize();
+  query_finalize();
   status = sqlite3_close(db_);
   error_check(status);
+  db_ = NULL;
+}
+
+/* Close the database and delete its files, e.g. between sweep points. */
+void benchmark_destroy() {
+  const char *suffixes[] = { "", "-wal", "-shm", "-journal" };
+  char file_name[1100];
+  char db_name[1000];
+  size_t i;
+
+  snprintf(db_name, sizeof(db_name), "%s", sqlite3_db_filename(db_, "main"));
+  benchmark_fini();
+  for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+    snprintf(file_name, sizeof(file_name), "%s%s", db_name, suffixes[i]);
+    remove(file_name);
+  }
+}
+
+int benchmark_num_results() {
+  return num_results_;
+}
+
+Result* benchmark_result(int i) {
+  return &results_[i];
+}
+
+void benchmark_clear_results() {
+  int i;
+
+  for (i = 0; i < num_results_; i++)
+    free(results_[i].runs_);
+  free(results_);
+  results_ = NULL;
+  num_results_ = 0;
+}
+
+static void add_result(const char *name, const double *tput,
+                       const double *p50, const double *p99, int n) {
+  Result *r;
+
+  results_ = realloc(results_, sizeof(Result) * (num_results_ + 1));
+  r = &results_[num_results_++];
+  snprintf(r->name_, sizeof(r->name_), "%s", name);
+  report_config(r->config_, sizeof(r->config_));
+  r->ops_per_sec_ = stats_mean(tput, n);
+  r->micros_per_op_ = r->ops_per_sec_ > 0 ? 1e6 / r->ops_per_sec_ : 0;
+  r->p50_ = stats_mean(p50, n);
+  r->p99_ = stats_mean(p99, n);
+  r->rss_peak_mb_ = last_mem_.rss_peak_ / 1048576.0;
+  r->rss_steady_mb_ = last_mem_.rss_steady_ / 1048576.0;
+  r->warmup_secs_ = last_result_.warmup_secs_;
+  r->measured_secs_ = last_result_.measured_secs_;
+  r->num_runs_ = n;
+  r->runs_ = malloc(sizeof(double) * n);
+  memcpy(r->runs_, tput, sizeof(double) * n);
+  report_add(r);
 }
 
 int get_order(char *suffix) {
@@ -662,7 +2108,9 @@ int get_order(char *suffix) {
 void set_sync(char *name) {
   const int synclen = sizeof("sync") - 1;
   const int batchlen = sizeof("batch") - 1;
-  if (!strncmp(&name[strlen(name) - synclen], "sync", synclen) ||
+  if (FLAGS_synchronous != NULL)
+    set_pragma_str("synchronous", FLAGS_synchronous);
+  else if (!strncmp(&name[strlen(name) - synclen], "sync", synclen) ||
       !strncmp(&name[strlen(name) - batchlen], "batch", batchlen))
     set_pragma_str("synchronous", "FULL");
   else
@@ -674,17 +2122,749 @@ int get_batch_size(char* name) {
   return !strncmp(&name[strlen(name) - len], "batch", len) ? FLAGS_batch_size : 1;
 }
 
+/* Value size of a benchmark with a size suffix like 100K, or 0 if none. */
+int get_value_size(char* name) {
+  size_t len = strlen(name);
+  size_t i;
+
+  if (len < 2 || name[len - 1] != 'K')
+    return 0;
+  for (i = len - 1; i > 0 && isdigit((unsigned char)name[i - 1]); i--)
+    ;
+  if (i == len - 1)
+    return 0;
+
+  return atoi(&name[i]) * 1024;
+}
+
+static long num_scans(long num_reads) {
+  long n = num_reads / (FLAGS_scan_length > 0 ? FLAGS_scan_length : 1);
+
+  return n > 0 ? n : 1;
+}
+
+static long num_queries(long num_reads) {
+  long n = num_reads / FLAGS_query_rows;
+
+  return n > 0 ? n : 1;
+}
+
+typedef struct BtreeStats {
+  long leaves_;
+  long out_of_order_;
+  long overflow_;
+  int64_t used_;
+  int64_t total_;
+  int depth_;
+} BtreeStats;
+
+/*
+ * Page-level layout of one b-tree from the dbstat virtual table. Leaves
+ * are visited in key order; a leaf that does not directly follow its
+ * predecessor in the file counts as out of order.
+ */
+static bool btree_stats(const char *btree, BtreeStats *bs) {
+  sqlite3_stmt *stmt;
+  long prev = -1, pageno;
+  const char *path, *type;
+  int depth, status;
+
+  memset(bs, 0, sizeof(*bs));
+  status = sqlite3_prepare_v2(db_,
+      "SELECT path, pageno, pagetype, unused, pgsize FROM dbstat "
+      "WHERE name = ? ORDER BY path", -1, &stmt, NULL);
+  if (status != SQLITE_OK)
+    return false;
+  sqlite3_bind_text(stmt, 1, btree, -1, SQLITE_STATIC);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    path = (const char *)sqlite3_column_text(stmt, 0);
+    pageno = sqlite3_column_int64(stmt, 1);
+    type = (const char *)sqlite3_column_text(stmt, 2);
+    if (!strcmp(type, "overflow")) {
+      bs->overflow_++;
+      continue;
+    }
+    for (depth = 0; *path; path++)
+      depth += (*path == '/');
+    if (depth > bs->depth_)
+      bs->depth_ = depth;
+    if (strcmp(type, "leaf"))
+      continue;
+
+    bs->leaves_++;
+    if (prev >= 0 && pageno != prev + 1)
+      bs->out_of_order_++;
+    prev = pageno;
+    bs->total_ += sqlite3_column_int(stmt, 4);
+    bs->used_ += sqlite3_column_int(stmt, 4) - sqlite3_column_int(stmt, 3);
+  }
+  sqlite3_finalize(stmt);
+
+  return true;
+}
+
+static void print_fragmentation(void) {
+  const char *btrees[] = { "test", "sqlite_autoindex_test_1" };
+  BtreeStats bs;
+  size_t i;
+
+  for (i = 0; i < sizeof(btrees) / sizeof(btrees[0]); i++) {
+    if (!btree_stats(btrees[i], &bs)) {
+      fprintf(stderr, "Fragmentation: dbstat is not available\n");
+      return;
+    }
+    if (bs.leaves_ == 0)
+      continue;
+    fprintf(stderr, "  %-24s %8ld leaves, %5.1f%% out of order, "
+            "fill %5.1f%%, depth %d, %ld overflow pages\n",
+            btrees[i], bs.leaves_,
+            bs.leaves_ > 1 ? 100.0 * bs.out_of_order_ / (bs.leaves_ - 1) : 0.0,
+            bs.total_ ? 100.0 * bs.used_ / bs.total_ : 0.0,
+            bs.depth_, bs.overflow_);
+  }
+}
+
+/*
+ * Pages a point lookup touches: the depth of the key index plus the
+ * depth of the table for rowid_blob, just the table otherwise. dbstat
+ * reads every page of both b-trees, so the depths are measured once
+ * after the table changes and reused by the read benchmarks that follow.
+ */
+static void print_lookup_depth(void) {
+  static int table_depth_, index_depth_;
+  BtreeStats bs;
+
+  if (!lookup_depth_valid_) {
+    if (!btree_stats("test", &bs))
+      return;
+    table_depth_ = bs.depth_;
+    index_depth_ = 0;
+    if (key_layout() == LAYOUT_ROWID_BLOB &&
+        btree_stats("sqlite_autoindex_test_1", &bs))
+      index_depth_ = bs.depth_;
+    lookup_depth_valid_ = true;
+  }
+
+  if (key_layout() == LAYOUT_ROWID_BLOB) {
+    fprintf(stderr, "Lookup:     %s, index depth %d + table depth %d = "
+            "%d pages per point lookup\n", key_layout_name(), index_depth_,
+            table_depth_, index_depth_ + table_depth_);
+  } else {
+    fprintf(stderr, "Lookup:     %s, table depth %d = %d pages per point "
+            "lookup\n", key_layout_name(), table_depth_, table_depth_);
+  }
+}
+
+static void aging_measure(Workload *w, const char *when) {
+  char label[64];
+
+  snprintf(label, sizeof(label), "readseq@%s", when);
+  start();
+  benchmark_read(SEQUENTIAL, w->num_entries_, w->num_entries_, 1);
+  stop(label);
+  add_result(label, &last_result_.ops_per_sec_, &last_result_.p50_,
+             &last_result_.p99_, 1);
+
+  snprintf(label, sizeof(label), "scan@%s", when);
+  start();
+  benchmark_scan(RANDOM, num_scans(w->num_reads_), w->num_entries_,
+                 FLAGS_scan_length);
+  stop(label);
+  add_result(label, &last_result_.ops_per_sec_, &last_result_.p50_,
+             &last_result_.p99_, 1);
+
+  print_fragmentation();
+}
+
+static void exec_sql(const char *sql) {
+  char *err_msg = NULL;
+  int status;
+
+  status = sqlite3_exec(db_, sql, NULL, NULL, &err_msg);
+  exec_error_check(status, err_msg);
+}
+
+static double timed_exec(const char *sql) {
+  double t0 = now_micros() * 1e-6;
+
+  exec_sql(sql);
+
+  return now_micros() * 1e-6 - t0;
+}
+
+/*
+ * Drop test and shrink the file so the prefill that follows lays the
+ * table out as on a new database, for aging after earlier writes.
+ */
+static void aging_reset(void) {
+  exec_sql("DROP TABLE test");
+  exec_sql("VACUUM");
+  wal_checkpoint(db_);
+  exec_sql(key_schema());
+  loaded_entries_ = 0;
+  lookup_depth_valid_ = false;
+}
+
+/*
+ * Measure sequential reads and range scans on a freshly loaded table,
+ * age it with random overwrites and deletes, measure again, then time
+ * VACUUM INTO and VACUUM and measure a third time.
+ */
+static void benchmark_aging(Workload *w) {
+  char sql[1200];
+  char file_name[1100];
+  long aging_ops = duration_ops(FLAGS_aging_ops > 0 ? FLAGS_aging_ops :
+                                                      w->num_ops_);
+  long i;
+  double secs;
+  int k, value_size;
+  char key[100];
+  const char *value;
+  sqlite3_stmt *stmt;
+  int status;
+
+  aging_measure(w, "fresh");
+
+  start();
+  deadline_set(FLAGS_duration);
+  for (i = 0; i < aging_ops && !time_up(); i += w->batch_size_) {
+    stmt_runonce(stmts[STMT_TSTART]);
+    for (k = 0; k < w->batch_size_; k++) {
+      if ((int)rand_uniform(&rand_, 100) < FLAGS_aging_delete_percent) {
+        stmt = stmts[STMT_DELETE];
+        bind_key(stmt, 1, key, rand_key(&rand_, w->num_entries_));
+      } else {
+        value_size = value_dist_next(w->dist_, &rand_);
+        value = rand_gen_generate(&gen_, value_size);
+        stmt = stmts[STMT_REPLACE];
+        bind_key(stmt, 1, key, rand_key(&rand_, w->num_entries_));
+        status = sqlite3_bind_blob(stmt, 2, value, value_size, SQLITE_TRANSIENT);
+        error_check(status);
+        bytes_ += value_size + key_size();
+      }
+      status = sqlite3_step(stmt);
+      step_error_check(status);
+      stmt_clear_and_reset(stmt);
+    }
+    stmt_runonce(stmts[STMT_TEND]);
+    finished_single_op(WRITE);
+  }
+  deadline_set(0);
+  wal_checkpoint(db_);
+  stop("aging");
+  add_result("aging", &last_result_.ops_per_sec_, &last_result_.p50_,
+             &last_result_.p99_, 1);
+  print_space_stats();
+
+  aging_measure(w, "aged");
+
+  snprintf(file_name, sizeof(file_name), "%s.vacuum",
+           sqlite3_db_filename(db_, "main"));
+  remove(file_name);
+  snprintf(sql, sizeof(sql), "VACUUM INTO '%s'", file_name);
+  secs = timed_exec(sql);
+  fprintf(stderr, "%-12s : %11.3f ms; %.2f MB written\n", "vacuum_into",
+          secs * 1e3, file_size(file_name) / 1048576.0);
+  remove(file_name);
+
+  /* VACUUM rewrites the database through the WAL; fold it back in. */
+  secs = timed_exec("VACUUM");
+  wal_checkpoint(db_);
+  fprintf(stderr, "%-12s : %11.3f ms\n", "vacuum", secs * 1e3);
+  print_space_stats();
+
+  aging_measure(w, "vacuumed");
+}
+
+/* Work out what a benchmark does from its name. */
+static bool is_read_workload(int type) {
+  return type == BENCH_READ || type == BENCH_SCAN ||
+         type == BENCH_BLOB_READ || type == BENCH_ROW_READ ||
+         type == BENCH_READ_MISS || type == BENCH_QUERY;
+}
+
+/* JSON benchmarks use the docs table and leave the test table alone. */
+static bool is_json_workload(int type) {
+  return type == BENCH_JSON_FILL || type == BENCH_JSON_READ ||
+         type == BENCH_JSON_UPDATE;
+}
+
+static const char *query_benchmarks[kNumQueryTypes] = {
+  "queryagg", "querygroup", "querytopn", "querysort", "queryjoin"
+};
+
+static void workload_init(Workload *w, char *name) {
+  char *suffix = "";
+  int i;
+
+  w->name_ = name;
+  w->type_ = BENCH_UNKNOWN;
+  w->keys_ = NULL;
+  w->mutated_ = 0;
+
+  /* Get the benchmark type and ordering by parsing the prefix of the name. */
+  if (!strcmp(name, "readwhilewriting")) {
+    w->type_ = BENCH_CONCURRENT;
+  } else if (!strncmp(name, "groupcommit", sizeof("groupcommit") - 1)) {
+    w->type_ = BENCH_GROUP_COMMIT;
+  } else if (!strcmp(name, "load")) {
+    w->type_ = BENCH_LOAD;
+  } else if (!strcmp(name, "readrandommiss")) {
+    w->type_ = BENCH_READ_MISS;
+  } else if (!strncmp(name, "query", sizeof("query") - 1)) {
+    for (i = 0; i < kNumQueryTypes; i++) {
+      if (!strcmp(name, query_benchmarks[i])) {
+        w->type_ = BENCH_QUERY;
+        w->query_ = i;
+      }
+    }
+  } else if (!strncmp(name, "jsonfill", sizeof("jsonfill") - 1)) {
+    w->type_ = BENCH_JSON_FILL;
+    suffix = &name[sizeof("jsonfill") - 1];
+  } else if (!strncmp(name, "jsonread", sizeof("jsonread") - 1)) {
+    w->type_ = BENCH_JSON_READ;
+    suffix = &name[sizeof("jsonread") - 1];
+  } else if (!strncmp(name, "jsonupdate", sizeof("jsonupdate") - 1)) {
+    w->type_ = BENCH_JSON_UPDATE;
+    suffix = &name[sizeof("jsonupdate") - 1];
+  } else if (!strncmp(name, "rmwrandom", sizeof("rmwrandom") - 1)) {
+    w->type_ = BENCH_RMW;
+  } else if (!strncmp(name, "incrandom", sizeof("incrandom") - 1)) {
+    w->type_ = BENCH_INCREMENT;
+  } else if (!strncmp(name, "fill", sizeof("fill") - 1)) {
+    w->type_ = BENCH_FILL;
+    suffix = &name[sizeof("fill") - 1];
+  } else if (!strncmp(name, "rw", sizeof("rw") - 1)) {
+    w->type_ = BENCH_RW;
+    suffix = &name[sizeof("rw") - 1];
+  } else if (!strncmp(name, "read", sizeof("read") - 1)) {
+    w->type_ = BENCH_READ;
+    suffix = &name[sizeof("read") - 1];
+  } else if (!strncmp(name, "update", sizeof("update") - 1)) {
+    w->type_ = BENCH_UPDATE;
+    suffix = &name[sizeof("update") - 1];
+  } else if (!strncmp(name, "delete", sizeof("delete") - 1)) {
+    w->type_ = BENCH_DELETE;
+    suffix = &name[sizeof("delete") - 1];
+  } else if (!strncmp(name, "churn", sizeof("churn") - 1)) {
+    w->type_ = BENCH_CHURN;
+    suffix = &name[sizeof("churn") - 1];
+  } else if (!strncmp(name, "scan", sizeof("scan") - 1)) {
+    w->type_ = BENCH_SCAN;
+    suffix = &name[sizeof("scan") - 1];
+  } else if (!strcmp(name, "aging")) {
+    w->type_ = BENCH_AGING;
+  } else if (!strncmp(name, "blobread", sizeof("blobread") - 1)) {
+    w->type_ = BENCH_BLOB_READ;
+  } else if (!strncmp(name, "blobwrite", sizeof("blobwrite") - 1)) {
+    w->type_ = BENCH_BLOB_WRITE;
+  } else if (!strncmp(name, "rowread", sizeof("rowread") - 1)) {
+    w->type_ = BENCH_ROW_READ;
+  } else if (!strncmp(name, "rowwrite", sizeof("rowwrite") - 1)) {
+    w->type_ = BENCH_ROW_WRITE;
+  }
+  w->order_ = get_order(suffix);
+  w->batch_size_ = get_batch_size(name);
+
+  /* Size-suffixed benchmarks do N/1000 operations on large values. */
+  w->value_size_ = get_value_size(name);
+  if (w->value_size_ > 0) {
+    value_dist_fixed(&w->big_dist_, w->value_size_);
+    w->dist_ = &w->big_dist_;
+    w->num_ops_ = num_ops_ / 1000 > 0 ? num_ops_ / 1000 : 1;
+    w->num_reads_ = reads_ / 1000 > 0 ? reads_ / 1000 : 1;
+    w->num_entries_ = num_keys_ / 1000 > 0 ? num_keys_ / 1000 : 1;
+  } else {
+    w->dist_ = &value_dist_;
+    w->num_ops_ = num_ops_;
+    w->num_reads_ = reads_;
+    w->num_entries_ = num_keys_;
+  }
+
+  /*
+   * Benchmarks that modify existing rows, or read over the whole key
+   * range, need the whole table loaded. Pure writers (group commit) and
+   * incrandom, which has its own counters table, do not.
+   */
+  if (w->type_ == BENCH_LOAD || is_json_workload(w->type_)) {
+    w->prefill_entries_ = 0;
+    w->prefill_value_size_ = FLAGS_value_size;
+  } else if (w->value_size_ > 0) {
+    w->prefill_entries_ = w->num_entries_;
+    w->prefill_value_size_ = w->value_size_;
+  } else if (w->type_ == BENCH_UPDATE || w->type_ == BENCH_DELETE ||
+             w->type_ == BENCH_CHURN || w->type_ == BENCH_SCAN ||
+             w->type_ == BENCH_AGING || w->type_ == BENCH_BLOB_READ ||
+             w->type_ == BENCH_BLOB_WRITE || w->type_ == BENCH_ROW_READ ||
+             w->type_ == BENCH_ROW_WRITE || w->type_ == BENCH_CONCURRENT ||
+             w->type_ == BENCH_READ_MISS || w->type_ == BENCH_RMW ||
+             w->type_ == BENCH_QUERY) {
+    w->prefill_entries_ = w->num_entries_;
+    w->prefill_value_size_ = FLAGS_value_size;
+  } else {
+    w->prefill_entries_ = 1000;
+    w->prefill_value_size_ = (int)(num_keys_ / 1000);
+  }
+}
+
+static void workload_run(Workload *w, long num_ops, long num_reads) {
+  switch (w->type_) {
+  case BENCH_FILL:
+    benchmark_write(w->order_, num_ops, w->num_entries_, w->dist_,
+                    w->batch_size_);
+    break;
+  case BENCH_RW:
+    benchmark_readwrite(w->order_, num_ops, w->num_entries_, w->dist_,
+                        w->batch_size_, FLAGS_write_percent);
+    break;
+  case BENCH_READ:
+    benchmark_read(w->order_, num_reads, w->num_entries_, 1);
+    break;
+  case BENCH_READ_MISS:
+    benchmark_read_miss(num_reads, w->num_entries_);
+    break;
+  case BENCH_LOAD:
+    benchmark_load(w->num_entries_);
+    break;
+  case BENCH_UPDATE:
+  case BENCH_DELETE:
+  case BENCH_CHURN:
+    benchmark_mutate(w, num_ops);
+    break;
+  case BENCH_SCAN:
+    benchmark_scan(w->order_, num_scans(num_reads), w->num_entries_,
+                   FLAGS_scan_length);
+    break;
+  case BENCH_BLOB_READ:
+  case BENCH_ROW_READ:
+    benchmark_range(w->type_, num_reads, w->num_entries_,
+                    w->prefill_value_size_);
+    break;
+  case BENCH_BLOB_WRITE:
+  case BENCH_ROW_WRITE:
+    benchmark_range(w->type_, num_ops, w->num_entries_,
+                    w->prefill_value_size_);
+    break;
+  case BENCH_JSON_FILL:
+  case BENCH_JSON_UPDATE:
+    benchmark_json(w->type_, w->order_, num_ops, w->num_entries_, w->dist_,
+                   w->batch_size_);
+    break;
+  case BENCH_JSON_READ:
+    benchmark_json(w->type_, w->order_, num_reads, w->num_entries_, w->dist_,
+                   1);
+    break;
+  case BENCH_QUERY:
+    benchmark_query(w->query_, num_queries(num_reads), w->num_entries_);
+    break;
+  }
+}
+
+/*
+ * Repeat the workload until interval throughput is steady, for at most
+ * kSteadyMaxWindows windows, and report this warmup window on its own.
+ */
+static void steady_warmup(Workload *w) {
+  double secs;
+
+  start();
+  memset(&steady_, 0, sizeof(steady_));
+  steady_.watching_ = true;
+  steady_.last_ = start_;
+  deadline_set(kSteadyMaxWindows * FLAGS_steady_window *
+               FLAGS_steady_interval_ms * 1e-3);
+  do {
+    workload_run(w, w->num_ops_, w->num_reads_);
+  } while (!time_up());
+  deadline_set(0);
+  wal_checkpoint(db_);
+  secs = now_micros() * 1e-6 - start_;
+
+  fprintf(stderr, "%-12s : %.1f s, %ld ops, %.1f ops/sec; %s after %d "
+          "intervals (cv %.2f%%)\n", "warmup", secs, done_, done_ / secs,
+          steady_.reached_ ? "steady" : "not steady", steady_.intervals_,
+          steady_.cv_ * 100);
+  last_result_.warmup_secs_ = secs;
+  steady_.watching_ = false;
+  steady_.reached_ = false;
+}
+
+/*
+ * Run the warmup, if any, then the measured window: one pass of the
+ * workload, or as many passes as fit in --duration seconds.
+ */
+static void workload_measure(Workload *w, const char *label) {
+  bool cold = FLAGS_cold && FLAGS_oid == 0 && is_read_workload(w->type_);
+  IoSample before, after;
+
+  last_result_.warmup_secs_ = 0;
+  if (FLAGS_warmup_ops > 0) {
+    start();
+    workload_run(w, FLAGS_warmup_ops, FLAGS_warmup_ops);
+    wal_checkpoint(db_);
+  }
+  if (FLAGS_steady_cv > 0 && w->type_ != BENCH_LOAD)
+    steady_warmup(w);
+  if (cold)
+    cold_start(w->type_ == BENCH_SCAN ? num_scans(w->num_reads_) :
+               w->type_ == BENCH_QUERY ? num_queries(w->num_reads_) :
+               w->num_reads_);
+
+  io_sample(&before);
+  start();
+  deadline_set(FLAGS_duration);
+  do {
+    workload_run(w, w->num_ops_, w->num_reads_);
+  } while (FLAGS_duration > 0 && w->type_ != BENCH_LOAD && !time_up());
+  deadline_set(0);
+  wal_checkpoint(db_);
+  stop(label);
+  if (FLAGS_steady_cv > 0 || FLAGS_duration > 0)
+    fprintf(stderr, "  windows    : warmup %.1f s, measured %.1f s "
+            "(%ld ops)\n", last_result_.warmup_secs_,
+            last_result_.measured_secs_, done_);
+  if (cold)
+    cold_print();
+  io_sample(&after);
+  if (FLAGS_io_stats || FLAGS_mmap_compare)
+    print_io_stats(&before, &after, done_);
+  if (FLAGS_phase_stats)
+    print_phase_stats();
+
+  if (w->type_ == BENCH_UPDATE || w->type_ == BENCH_DELETE ||
+      w->type_ == BENCH_CHURN || FLAGS_stats_interval > 0)
+    print_space_stats();
+}
+
+static void print_summary_line(const char *what, const double *v, int n) {
+  double mean = stats_mean(v, n);
+  double ci = stats_ci95(v, n);
+
+  fprintf(stderr, "  %-11s: mean %.3f median %.3f stddev %.3f "
+          "95%% CI [%.3f, %.3f]\n",
+          what, mean, stats_median(v, n), stats_stddev(v, n),
+          mean - ci, mean + ci);
+}
+
+static void print_repetitions(const char *name, const double *tput,
+                              const double *p99, int n) {
+  fprintf(stderr, "%-12s : %d runs; throughput cv %.2f%%\n",
+          name, n, stats_cv(tput, n) * 100);
+  print_summary_line("ops/sec", tput, n);
+  print_summary_line("p99 micros", p99, n);
+}
+
+/*
+ * Reader threads and a writer on connections of their own. Needs WAL and
+ * NORMAL locking; under EXCLUSIVE this connection would lock them out.
+ */
+static void benchmark_concurrent(Workload *w) {
+  ConcurrentStats *stats;
+  int k, p;
+
+  if (!FLAGS_WAL_enabled || !strcasecmp(FLAGS_locking_mode, "EXCLUSIVE")) {
+    fprintf(stderr, "%-12s : skipped, needs WAL and --locking_mode=NORMAL\n",
+            w->name_);
+    return;
+  }
+
+  stats = malloc(sizeof(ConcurrentStats));
+  start();
+  deadline_set(FLAGS_duration);
+  concurrent_run(sqlite3_db_filename(db_, "main"),
+                 FLAGS_threads > 0 ? FLAGS_threads : 1, true,
+                 FLAGS_reader_scan_percent, w->num_entries_, w->dist_,
+                 duration_ops(w->num_reads_), stats);
+  deadline_set(0);
+  done_ = stats->num_reads_;
+  /* The result's latency is read latency; commits are reported below. */
+  for (k = 0; k < kNumReadKinds; k++)
+    for (p = 0; p < kNumReadPhases; p++)
+      histogram_merge(&hist_rd_, &stats->reads_[k][p]);
+  stop(w->name_);
+  concurrent_print(stats);
+  add_result(w->name_, &last_result_.ops_per_sec_, &last_result_.p50_,
+             &last_result_.p99_, 1);
+  free(stats);
+}
+
+/*
+ * Read-modify-write clients on connections of their own. Needs NORMAL
+ * locking; an op is one committed transaction.
+ */
+static void benchmark_rmw(Workload *w) {
+  RmwStats *stats;
+
+  if (!strcasecmp(FLAGS_locking_mode, "EXCLUSIVE")) {
+    fprintf(stderr, "%-12s : skipped, needs --locking_mode=NORMAL\n",
+            w->name_);
+    return;
+  }
+
+  stats = malloc(sizeof(RmwStats));
+  start();
+  deadline_set(FLAGS_duration);
+  rmw_run(db_, w->type_ == BENCH_INCREMENT,
+          FLAGS_threads > 0 ? FLAGS_threads : 1, duration_ops(w->num_ops_),
+          w->num_entries_, w->dist_, w->batch_size_, stats);
+  deadline_set(0);
+  wal_checkpoint(db_);
+  done_ = stats->txns_;
+  bytes_ = stats->read_bytes_;
+  histogram_merge(&hist_wr_, &stats->latency_);
+  stop(w->name_);
+  rmw_print(stats);
+  add_result(w->name_, &last_result_.ops_per_sec_, &last_result_.p50_,
+             &last_result_.p99_, 1);
+  free(stats);
+}
+
+/* Group commit with 1, 2, 4, ... up to FLAGS_threads clients. */
+static void benchmark_group_commit(Workload *w) {
+  GroupCommitStats *stats = malloc(sizeof(GroupCommitStats));
+  int max_clients = FLAGS_threads > 0 ? FLAGS_threads : 1;
+  char label[128];
+  int clients;
+
+  for (clients = 1; ; clients = (clients * 2 < max_clients) ? clients * 2 :
+                                                                max_clients) {
+    snprintf(label, sizeof(label), "%s@clients=%d", w->name_, clients);
+    start();
+    deadline_set(FLAGS_duration);
+    groupcommit_run(db_, clients, duration_ops(w->num_ops_), w->num_entries_,
+                    w->dist_, stats);
+    deadline_set(0);
+    wal_checkpoint(db_);
+    done_ = stats->requests_;
+    histogram_merge(&hist_wr_, &stats->latency_);
+    stop(label);
+    fprintf(stderr, "  %ld transactions, %.1f requests/txn (max %ld), "
+            "%.3f fsyncs/request\n", stats->batches_,
+            stats->batches_ ? (double)stats->requests_ / stats->batches_ : 0.0,
+            stats->max_batch_,
+            stats->requests_ ? (double)stats->syncs_ / stats->requests_ : 0.0);
+    add_result(label, &last_result_.ops_per_sec_, &last_result_.p50_,
+               &last_result_.p99_, 1);
+    if (clients == max_clients)
+      break;
+  }
+  free(stats);
+}
+
+/*
+ * Rerun a point lookup, scan or readwhilewriting benchmark with 1, 2,
+ * 4, ... up to FLAGS_threads reader threads, each on its own connection,
+ * and report throughput per core against the single-thread run.
+ */
+static void benchmark_scaling(Workload *w) {
+  ConcurrentStats *stats;
+  int max_threads = FLAGS_threads > 0 ? FLAGS_threads : 1;
+  bool with_writer = (w->type_ == BENCH_CONCURRENT);
+  int scan_percent = (w->type_ == BENCH_SCAN) ? 100 :
+                     with_writer ? FLAGS_reader_scan_percent : 0;
+  double base = 0, per_core;
+  char label[128];
+  int threads, cores, k, p;
+
+  if (!FLAGS_WAL_enabled || !strcasecmp(FLAGS_locking_mode, "EXCLUSIVE")) {
+    fprintf(stderr, "%-12s : skipped, --scaling needs WAL and "
+            "--locking_mode=NORMAL\n", w->name_);
+    return;
+  }
+
+  stats = malloc(sizeof(ConcurrentStats));
+  for (threads = 1; ; threads = (threads * 2 < max_threads) ? threads * 2 :
+                                                                max_threads) {
+    snprintf(label, sizeof(label), "%s@threads=%d", w->name_, threads);
+    start();
+    deadline_set(FLAGS_duration);
+    concurrent_run(sqlite3_db_filename(db_, "main"), threads, with_writer,
+                   scan_percent, w->num_entries_, w->dist_,
+                   duration_ops(w->num_reads_), stats);
+    deadline_set(0);
+    done_ = stats->num_reads_;
+    for (k = 0; k < kNumReadKinds; k++)
+      for (p = 0; p < kNumReadPhases; p++)
+        histogram_merge(&hist_rd_, &stats->reads_[k][p]);
+    stop(label);
+
+    cores = threads < affinity_num_cpus() ? threads : affinity_num_cpus();
+    per_core = last_result_.ops_per_sec_ / cores;
+    if (threads == 1)
+      base = last_result_.ops_per_sec_;
+    fprintf(stderr, "  %d threads on %d cores: %.1f ops/sec per core, "
+            "%.1fx of 1 thread (%.0f%% efficiency)\n", threads, cores, per_core,
+            base > 0 ? last_result_.ops_per_sec_ / base : 0.0,
+            base > 0 ? 100.0 * last_result_.ops_per_sec_ / base / threads : 0.0);
+    add_result(label, &last_result_.ops_per_sec_, &last_result_.p50_,
+               &last_result_.p99_, 1);
+    if (threads == max_threads)
+      break;
+  }
+  free(stats);
+}
+
+/*
+ * Run a read workload with mmap off, covering half of the database file
+ * and covering all of it. The I/O counters after each run show how many
+ * page reads went through pread and how many were served by the mapping.
+ */
+static void benchmark_mmap_compare(Workload *w) {
+  const char *modes[] = { "off", "half", "full" };
+  int64_t size = file_size(sqlite3_db_filename(db_, "main"));
+  long want, got;
+  char label[128];
+  size_t i;
+
+  for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    want = (i == 0) ? 0 : (i == 1) ? size / 2 : size + page_size_;
+    set_pragma_int("mmap_size", want);
+    got = get_pragma_int("mmap_size");
+    if (got < want)
+      fprintf(stderr, "mmap_size capped at %ld of %ld bytes\n", got, want);
+
+    snprintf(label, sizeof(label), "%s@mmap=%s", w->name_, modes[i]);
+    workload_measure(w, label);
+    add_result(label, &last_result_.ops_per_sec_, &last_result_.p50_,
+               &last_result_.p99_, 1);
+  }
+
+  set_pragma_int("mmap_size", (long)FLAGS_mmap_size_mb * 1024 * 1024);
+}
+
 void benchmark_run() {
+  Workload w;
   char* benchmarks;
-  int batch_size;
-  char *suffix;
-
-  print_header();
+  char label[128];
+  double *tput, *p50, *p99;
+  int prev_type = BENCH_UNKNOWN;
+  bool table_written = false;
+  int max_reps, min_reps;
+  bool repeat;
+  int rep;
+
+  if (!header_printed_) {
+    print_header();
+    header_printed_ = true;
+  }
   benchmark_open();
 
   if (FLAGS_raw)
 	  rawfile_ = fopen(RAWFILE, "w+");
 
+  repeat = FLAGS_repetitions > 1 || FLAGS_cv_threshold > 0;
+  min_reps = FLAGS_repetitions > 1 ? FLAGS_repetitions : 1;
+  max_reps = min_reps;
+  if (FLAGS_cv_threshold > 0) {
+    if (min_reps < 3)
+      min_reps = 3;
+    max_reps = FLAGS_max_repetitions > min_reps ? FLAGS_max_repetitions : min_reps;
+  }
+  tput = malloc(sizeof(double) * max_reps);
+  p50 = malloc(sizeof(double) * max_reps);
+  p99 = malloc(sizeof(double) * max_reps);
+
   benchmarks = FLAGS_benchmarks;
   while (benchmarks != NULL) {
     char* sep = strchr(benchmarks, ',');
@@ -697,36 +2877,122 @@ void benchmark_run() {
       strncpy(name, benchmarks, sep - benchmarks);
       benchmarks = sep + 1;
     }
+
+    workload_init(&w, name);
+    perm_init(&perm_, w.num_entries_, 301);
+    if (w.type_ == BENCH_UNKNOWN) {
+      if (strcmp(name, "")) {
+        fprintf(stderr, "unknown benchmark '%s'\n", name);
+        /* A training mix that skips a workload would quietly miss it. */
+        if (FLAGS_pgo_training)
+          exit(1);
+      }
+      continue;
+    }
+    if ((w.type_ == BENCH_BLOB_READ || w.type_ == BENCH_BLOB_WRITE) &&
+        key_layout() == LAYOUT_WITHOUT_ROWID) {
+      fprintf(stderr, "%-12s : skipped, incremental blob I/O needs a rowid\n",
+              name);
+      continue;
+    }
+    export_benchmark(name, sqlite3_db_filename(db_, "main"));
+    slowop_benchmark(name);
+
     bytes_ = 0;
     /* Get the sync and batch size by checking the suffix of the benchmark. */
     set_sync(name);
-    batch_size = get_batch_size(name);
+    track_sizes_ = w.value_size_ > 0 || value_dist_.kind_ != DIST_FIXED;
+
+    /* Prepopulate the database, unless the last benchmark left it as is. */
+    if (!is_read_workload(prev_type) && prev_type != BENCH_LOAD)
+      loaded_entries_ = 0;
+    /* A benchmark that writes to test changes the depth it reports. */
+    if (!is_read_workload(w.type_))
+      lookup_depth_valid_ = false;
+    if (prev_type != BENCH_UNKNOWN && !is_read_workload(prev_type))
+      table_written = true;
+    prev_type = w.type_;
+    /* Aging compares against a fresh table, not what earlier writes left. */
+    if (w.type_ == BENCH_AGING && table_written)
+      aging_reset();
+    benchmark_prefill(w.prefill_value_size_, w.prefill_entries_);
+    if (is_json_workload(w.type_) && !json_prefill(&w))
+      continue;
+
+    if (w.type_ == BENCH_AGING) {
+      benchmark_aging(&w);
+      continue;
+    }
 
-    /* Prepopulate the database. */
-    benchmark_prefill(num_keys_ / 1000, 1000);
+    if (FLAGS_scaling && (w.type_ == BENCH_READ || w.type_ == BENCH_SCAN ||
+                          w.type_ == BENCH_CONCURRENT)) {
+      benchmark_scaling(&w);
+      continue;
+    }
 
-    start();
+    if (w.type_ == BENCH_CONCURRENT) {
+      benchmark_concurrent(&w);
+      continue;
+    }
 
-    /* Get the benchmark type and ordering by parsing the prefix of the name. */
-    if (!strncmp(name, "fill", sizeof("fill") - 1)) {
-      suffix = &name[sizeof("fill") - 1];
-      benchmark_write(get_order(suffix), num_ops_, num_keys_, FLAGS_value_size, batch_size);
-    } else if (!strncmp(name, "rw", sizeof("rw") - 1)) {
-      suffix = &name[sizeof("rw") - 1];
-      benchmark_readwrite(get_order(suffix), num_ops_, num_keys_, FLAGS_value_size, batch_size, FLAGS_write_percent);
-    } else if (!strncmp(name, "read", sizeof("read") - 1)) {
-      suffix = &name[sizeof("read") - 1];
-      benchmark_read(get_order(suffix), 1);
-    } else {
-      if (strcmp(name, ""))
-        fprintf(stderr, "unknown benchmark '%s'\n", name);
-	  continue;
+    if (w.type_ == BENCH_GROUP_COMMIT) {
+      benchmark_group_commit(&w);
+      continue;
     }
-    wal_checkpoint(db_);
-    stop(name);
+
+    if (w.type_ == BENCH_RMW || w.type_ == BENCH_INCREMENT) {
+      benchmark_rmw(&w);
+      continue;
+    }
+
+    if (is_read_workload(w.type_))
+      print_lookup_depth();
+
+    if (FLAGS_mmap_compare && is_read_workload(w.type_)) {
+      benchmark_mmap_compare(&w);
+      continue;
+    }
+
+    if (!repeat) {
+      workload_measure(&w, name);
+      add_result(name, &last_result_.ops_per_sec_, &last_result_.p50_,
+                 &last_result_.p99_, 1);
+      workload_reset_keys(&w);
+      continue;
+    }
+
+    /* Every repetition starts from the same database and key sequence. */
+    snapshot_save();
+    for (rep = 0; rep < max_reps; rep++) {
+      if (rep > 0) {
+        snapshot_restore();
+        workload_reset_keys(&w);
+      }
+      rand_seed(&rand_, 301, 0);
+
+      snprintf(label, sizeof(label), "%s#%d", name, rep + 1);
+      workload_measure(&w, label);
+      tput[rep] = last_result_.ops_per_sec_;
+      p50[rep] = last_result_.p50_;
+      p99[rep] = last_result_.p99_;
+
+      if (rep + 1 < min_reps)
+        continue;
+      if (FLAGS_cv_threshold <= 0 ||
+          stats_cv(tput, rep + 1) < FLAGS_cv_threshold) {
+        rep++;
+        break;
+      }
+    }
+    print_repetitions(name, tput, p99, rep);
+    add_result(name, tput, p50, p99, rep);
+    workload_reset_keys(&w);
   }
 
+  free(tput);
+  free(p50);
+  free(p99);
+
   if (FLAGS_raw)
 	  fclose(rawfile_);
 }
-
@@ -0,0 +1,308 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * Compare two result files written with --json. Benchmarks are matched
+ * by name and configuration string; a benchmark regresses if its
+ * throughput drops or its p99 latency grows by more than
+ * FLAGS_regression_threshold percent. When both sides carry at least two
+ * repetitions, a throughput change only counts if Welch's t-test finds
+ * it significant.
+ */
+
+enum JsonType {
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+};
+
+typedef struct JsonValue {
+  int type_;
+  double number_;
+  char *string_;
+  int num_items_;
+  char **keys_;
+  struct JsonValue **items_;
+} JsonValue;
+
+static JsonValue* json_parse_value(const char **p);
+
+static void json_skip_space(const char **p) {
+  while (isspace((unsigned char)**p))
+    (*p)++;
+}
+
+static JsonValue* json_new(int type) {
+  JsonValue *v = calloc(1, sizeof(JsonValue));
+
+  v->type_ = type;
+  return v;
+}
+
+static char* json_parse_string(const char **p) {
+  const char *s = *p + 1;
+  char *out = malloc(strlen(s) + 1);
+  size_t n = 0;
+  unsigned int code;
+
+  while (*s && *s != '"') {
+    if (*s == '\\' && s[1]) {
+      s++;
+      switch (*s) {
+      case 'n': out[n++] = '\n'; break;
+      case 't': out[n++] = '\t'; break;
+      case 'r': out[n++] = '\r'; break;
+      case 'b': out[n++] = '\b'; break;
+      case 'f': out[n++] = '\f'; break;
+      case 'u':
+        if (sscanf(s + 1, "%4x", &code) == 1) {
+          out[n++] = (code < 0x80) ? (char)code : '?';
+          s += 4;
+        }
+        break;
+      default: out[n++] = *s; break;
+      }
+      s++;
+    } else {
+      out[n++] = *s++;
+    }
+  }
+  out[n] = '\0';
+  *p = (*s == '"') ? s + 1 : s;
+
+  return out;
+}
+
+static void json_append(JsonValue *v, char *key, JsonValue *item) {
+  v->items_ = realloc(v->items_, sizeof(JsonValue *) * (v->num_items_ + 1));
+  v->keys_ = realloc(v->keys_, sizeof(char *) * (v->num_items_ + 1));
+  v->items_[v->num_items_] = item;
+  v->keys_[v->num_items_] = key;
+  v->num_items_++;
+}
+
+static JsonValue* json_parse_value(const char **p) {
+  JsonValue *v, *item;
+  char *key, *end;
+
+  json_skip_space(p);
+  switch (**p) {
+  case '{':
+    v = json_new(JSON_OBJECT);
+    (*p)++;
+    json_skip_space(p);
+    while (**p == '"') {
+      key = json_parse_string(p);
+      json_skip_space(p);
+      if (**p != ':')
+        return NULL;
+      (*p)++;
+      if ((item = json_parse_value(p)) == NULL)
+        return NULL;
+      json_append(v, key, item);
+      json_skip_space(p);
+      if (**p == ',') {
+        (*p)++;
+        json_skip_space(p);
+      }
+    }
+    if (**p != '}')
+      return NULL;
+    (*p)++;
+    return v;
+  case '[':
+    v = json_new(JSON_ARRAY);
+    (*p)++;
+    json_skip_space(p);
+    while (**p && **p != ']') {
+      if ((item = json_parse_value(p)) == NULL)
+        return NULL;
+      json_append(v, NULL, item);
+      json_skip_space(p);
+      if (**p == ',')
+        (*p)++;
+    }
+    if (**p != ']')
+      return NULL;
+    (*p)++;
+    return v;
+  case '"':
+    v = json_new(JSON_STRING);
+    v->string_ = json_parse_string(p);
+    return v;
+  case 't':
+  case 'f':
+    v = json_new(JSON_BOOL);
+    v->number_ = (**p == 't');
+    *p += (**p == 't') ? 4 : 5;
+    return v;
+  case 'n':
+    *p += 4;
+    return json_new(JSON_NULL);
+  default:
+    v = json_new(JSON_NUMBER);
+    v->number_ = strtod(*p, &end);
+    if (end == *p)
+      return NULL;
+    *p = end;
+    return v;
+  }
+}
+
+static JsonValue* json_get(JsonValue *obj, const char *key) {
+  int i;
+
+  if (obj == NULL || obj->type_ != JSON_OBJECT)
+    return NULL;
+  for (i = 0; i < obj->num_items_; i++)
+    if (!strcmp(obj->keys_[i], key))
+      return obj->items_[i];
+
+  return NULL;
+}
+
+static double json_number(JsonValue *obj, const char *key) {
+  JsonValue *v = json_get(obj, key);
+
+  return (v != NULL && v->type_ == JSON_NUMBER) ? v->number_ : 0;
+}
+
+static const char* json_str(JsonValue *obj, const char *key) {
+  JsonValue *v = json_get(obj, key);
+
+  return (v != NULL && v->type_ == JSON_STRING) ? v->string_ : "";
+}
+
+static JsonValue* json_load(const char *path) {
+  JsonValue *root;
+  const char *p;
+  char *text;
+  FILE *file;
+  long size;
+
+  file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(2);
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  text = malloc(size + 1);
+  size = fread(text, 1, size, file);
+  text[size] = '\0';
+  fclose(file);
+
+  p = text;
+  root = json_parse_value(&p);
+  if (root == NULL || json_get(root, "benchmarks") == NULL) {
+    fprintf(stderr, "%s: not a db_bench result file\n", path);
+    exit(2);
+  }
+  free(text);
+
+  return root;
+}
+
+static double* json_runs(JsonValue *bench, int *n) {
+  JsonValue *runs = json_get(bench, "runs");
+  double *v;
+  int i;
+
+  *n = 0;
+  if (runs == NULL || runs->type_ != JSON_ARRAY)
+    return NULL;
+  v = malloc(sizeof(double) * (runs->num_items_ + 1));
+  for (i = 0; i < runs->num_items_; i++)
+    v[(*n)++] = runs->items_[i]->number_;
+
+  return v;
+}
+
+static double delta_percent(double base, double cur) {
+  return (base == 0) ? 0 : (cur - base) * 100.0 / base;
+}
+
+/* Returns the number of regressions found. */
+int compare_run(const char *baseline_path, const char *current_path) {
+  JsonValue *base, *cur, *base_list, *cur_list, *b, *c;
+  double *base_runs, *cur_runs;
+  double tput_delta, p50_delta, p99_delta, t, df;
+  int n_base, n_cur, regressions = 0, matched = 0;
+  bool tested, significant, regressed;
+  char sig[32];
+  int i, j;
+
+  base = json_load(baseline_path);
+  cur = json_load(current_path);
+  base_list = json_get(base, "benchmarks");
+  cur_list = json_get(cur, "benchmarks");
+
+  fprintf(stderr, "Baseline:   %s (SQLite %s, %s)\n", baseline_path,
+          json_str(base, "sqlite_version"), json_str(base, "date"));
+  fprintf(stderr, "Current:    %s (SQLite %s, %s)\n", current_path,
+          json_str(cur, "sqlite_version"), json_str(cur, "date"));
+  fprintf(stderr, "Threshold:  %.1f%%\n", FLAGS_regression_threshold);
+  fprintf(stderr, "------------------------------------------------\n");
+  fprintf(stderr, "%-14s %14s %14s %9s %9s %9s %16s  %s\n",
+          "benchmark", "base ops/sec", "cur ops/sec", "ops/sec", "p50",
+          "p99", "significance", "verdict");
+
+  for (i = 0; i < cur_list->num_items_; i++) {
+    c = cur_list->items_[i];
+    b = NULL;
+    for (j = 0; j < base_list->num_items_; j++) {
+      if (!strcmp(json_str(c, "name"), json_str(base_list->items_[j], "name")) &&
+          !strcmp(json_str(c, "config"), json_str(base_list->items_[j], "config"))) {
+        b = base_list->items_[j];
+        break;
+      }
+    }
+    if (b == NULL) {
+      fprintf(stderr, "%-14s no baseline with config %s\n",
+              json_str(c, "name"), json_str(c, "config"));
+      continue;
+    }
+    matched++;
+
+    tput_delta = delta_percent(json_number(b, "ops_per_sec"),
+                               json_number(c, "ops_per_sec"));
+    p50_delta = delta_percent(json_number(b, "p50"), json_number(c, "p50"));
+    p99_delta = delta_percent(json_number(b, "p99"), json_number(c, "p99"));
+
+    base_runs = json_runs(b, &n_base);
+    cur_runs = json_runs(c, &n_cur);
+    tested = n_base >= 2 && n_cur >= 2;
+    significant = tested && stats_welch(base_runs, n_base, cur_runs, n_cur,
+                                        &t, &df);
+    if (tested)
+      snprintf(sig, sizeof(sig), "t=%.2f %s", t, significant ? "p<.05" : "n.s.");
+    else
+      snprintf(sig, sizeof(sig), "n/a");
+    free(base_runs);
+    free(cur_runs);
+
+    regressed = (tput_delta < -FLAGS_regression_threshold &&
+                 (!tested || significant)) ||
+                p99_delta > FLAGS_regression_threshold;
+    if (regressed)
+      regressions++;
+
+    fprintf(stderr, "%-14s %14.1f %14.1f %+8.1f%% %+8.1f%% %+8.1f%% %16s  %s\n",
+            json_str(c, "name"), json_number(b, "ops_per_sec"),
+            json_number(c, "ops_per_sec"), tput_delta, p50_delta, p99_delta,
+            sig, regressed ? "REGRESSION" : "ok");
+  }
+
+  fprintf(stderr, "------------------------------------------------\n");
+  fprintf(stderr, "%d of %d matched benchmarks regressed\n", regressions,
+          matched);
+
+  return regressions;
+}
@@ -0,0 +1,294 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * readwhilewriting: readers do point lookups and range scans on their own
+ * connections while one writer commits batches of REPLACEs at
+ * FLAGS_write_rate transactions per second and checkpoints the WAL from
+ * its wal hook. Every read is classified by what it overlapped: a
+ * checkpoint, a commit, or neither. The writer runs until the readers
+ * have finished their share of num_reads. Without a writer this is a
+ * plain multi-threaded read benchmark, used by --scaling.
+ */
+static const char *read_kind_names[kNumReadKinds] = { "point", "scan" };
+static const char *read_phase_names[kNumReadPhases] = {
+  "idle", "commit", "checkpoint"
+};
+
+typedef struct Reader {
+  pthread_t thread_;
+  int thread_num_;
+  int scan_percent_;
+  sqlite3 *db_;
+  Random rand_;
+  long num_reads_;
+  long num_entries_;
+  Histogram hist_[kNumReadKinds][kNumReadPhases];
+} Reader;
+
+typedef struct Writer {
+  pthread_t thread_;
+  sqlite3 *db_;
+  Random rand_;
+  RandomGenerator gen_;
+  ValueSizeDist *dist_;
+  long num_entries_;
+  long txns_;
+  long rows_;
+  Histogram commit_hist_;
+} Writer;
+
+/* Odd while the writer is inside COMMIT. */
+static uint64_t commit_seq_;
+static int readers_running_;
+
+/* Open another connection to path, set up like the benchmark's own. */
+sqlite3* concurrent_open(const char *path) {
+  char pragma[128];
+  sqlite3 *db;
+  char *err_msg = NULL;
+  int status;
+
+  status = sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE, NULL);
+  if (status != SQLITE_OK) {
+    fprintf(stderr, "open error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+  snprintf(pragma, sizeof(pragma),
+           "PRAGMA cache_size = %d; PRAGMA mmap_size = %ld; "
+           "PRAGMA busy_timeout = 5000",
+           FLAGS_num_pages, (long)FLAGS_mmap_size_mb * 1024 * 1024);
+  status = sqlite3_exec(db, pragma, NULL, NULL, &err_msg);
+  if (status != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", err_msg);
+    exit(1);
+  }
+
+  return db;
+}
+
+static sqlite3_stmt* prepare(sqlite3 *db, const char *sql) {
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "prepare error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+
+  return stmt;
+}
+
+static void step_done(sqlite3 *db, sqlite3_stmt *stmt) {
+  int status = sqlite3_step(stmt);
+
+  if (status != SQLITE_DONE) {
+    fprintf(stderr, "SQL step error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+  sqlite3_reset(stmt);
+}
+
+static void* reader_main(void *arg) {
+  Reader *r = arg;
+  sqlite3_stmt *point, *scan, *stmt;
+  uint64_t c0, c1, k0, k1, t0;
+  char key[100];
+  int kind, phase, status;
+  long i;
+
+  affinity_pin(r->thread_num_);
+  point = prepare(r->db_, "SELECT * FROM test WHERE key = ?");
+  scan = prepare(r->db_,
+                 "SELECT key, value FROM test WHERE key >= ? ORDER BY key LIMIT ?");
+
+  for (i = 0; i < r->num_reads_ && !deadline_passed(); i++) {
+    kind = (int)rand_uniform(&r->rand_, 100) < r->scan_percent_ ?
+           READ_SCAN : READ_POINT;
+    stmt = (kind == READ_SCAN) ? scan : point;
+    bind_key(stmt, 1, key, rand_key(&r->rand_, r->num_entries_));
+    if (kind == READ_SCAN)
+      sqlite3_bind_int(stmt, 2, FLAGS_scan_length);
+
+    c0 = __atomic_load_n(&commit_seq_, __ATOMIC_ACQUIRE);
+    k0 = wal_checkpoint_seq();
+    t0 = now_nanos();
+    while ((status = sqlite3_step(stmt)) == SQLITE_ROW)
+      ;
+    if (status != SQLITE_DONE) {
+      fprintf(stderr, "SQL step error: %s\n", sqlite3_errmsg(r->db_));
+      exit(1);
+    }
+    sqlite3_reset(stmt);
+    t0 = now_nanos() - t0;
+    c1 = __atomic_load_n(&commit_seq_, __ATOMIC_ACQUIRE);
+    k1 = wal_checkpoint_seq();
+
+    if ((k0 & 1) || k0 != k1)
+      phase = PHASE_CHECKPOINT;
+    else if ((c0 & 1) || c0 != c1)
+      phase = PHASE_COMMIT;
+    else
+      phase = PHASE_IDLE;
+    histogram_add(&r->hist_[kind][phase], t0 / 1e3);
+  }
+  r->num_reads_ = i;
+
+  sqlite3_finalize(point);
+  sqlite3_finalize(scan);
+  __atomic_fetch_sub(&readers_running_, 1, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+static void* writer_main(void *arg) {
+  Writer *w = arg;
+  sqlite3_stmt *begin, *commit, *replace;
+  uint64_t start, next, now, t0;
+  char key[100];
+  const char *value;
+  int value_size, j;
+
+  affinity_pin(1);
+  begin = prepare(w->db_, "BEGIN");
+  commit = prepare(w->db_, "COMMIT");
+  replace = prepare(w->db_, "REPLACE INTO test (key, value) VALUES (?, ?)");
+  wal_hook_install(w->db_, FLAGS_checkpoint_granularity);
+
+  start = now_nanos();
+  while (__atomic_load_n(&readers_running_, __ATOMIC_ACQUIRE) > 0) {
+    if (FLAGS_write_rate > 0) {
+      next = start + (uint64_t)(w->txns_ * 1e9 / FLAGS_write_rate);
+      now = now_nanos();
+      if (now < next)
+        usleep((next - now) / 1000);
+    }
+
+    step_done(w->db_, begin);
+    for (j = 0; j < FLAGS_batch_size; j++) {
+      bind_key(replace, 1, key, rand_key(&w->rand_, w->num_entries_));
+      value_size = value_dist_next(w->dist_, &w->rand_);
+      value = rand_gen_generate(&w->gen_, value_size);
+      sqlite3_bind_blob(replace, 2, value, value_size, SQLITE_TRANSIENT);
+      step_done(w->db_, replace);
+    }
+
+    /* The wal hook may checkpoint inside COMMIT; readers see both flags. */
+    __atomic_fetch_add(&commit_seq_, 1, __ATOMIC_RELEASE);
+    t0 = now_nanos();
+    step_done(w->db_, commit);
+    t0 = now_nanos() - t0;
+    __atomic_fetch_add(&commit_seq_, 1, __ATOMIC_RELEASE);
+
+    histogram_add(&w->commit_hist_, t0 / 1e3);
+    w->txns_++;
+    w->rows_ += FLAGS_batch_size;
+  }
+
+  sqlite3_finalize(begin);
+  sqlite3_finalize(commit);
+  sqlite3_finalize(replace);
+
+  return NULL;
+}
+
+void concurrent_run(const char *path, int num_readers, bool with_writer,
+                    int scan_percent, long num_entries, ValueSizeDist *dist,
+                    long num_reads, ConcurrentStats *stats) {
+  Reader *readers = calloc(num_readers, sizeof(Reader));
+  Writer writer;
+  WalStats wal0, wal1;
+  double start;
+  int i, k, p;
+
+  memset(stats, 0, sizeof(*stats));
+  for (k = 0; k < kNumReadKinds; k++)
+    for (p = 0; p < kNumReadPhases; p++)
+      histogram_clear(&stats->reads_[k][p]);
+  histogram_clear(&stats->commits_);
+
+  memset(&writer, 0, sizeof(writer));
+  writer.db_ = concurrent_open(path);
+  writer.dist_ = dist;
+  writer.num_entries_ = num_entries;
+  rand_seed(&writer.rand_, 1000, 0);
+  rand_gen_init(&writer.gen_, FLAGS_compression_ratio);
+  histogram_clear(&writer.commit_hist_);
+
+  readers_running_ = num_readers;
+  for (i = 0; i < num_readers; i++) {
+    readers[i].db_ = concurrent_open(path);
+    readers[i].thread_num_ = (with_writer ? 2 : 1) + i;
+    readers[i].scan_percent_ = scan_percent;
+    readers[i].num_reads_ = num_reads / num_readers;
+    readers[i].num_entries_ = num_entries;
+    rand_seed(&readers[i].rand_, 2000, i);
+    for (k = 0; k < kNumReadKinds; k++)
+      for (p = 0; p < kNumReadPhases; p++)
+        histogram_clear(&readers[i].hist_[k][p]);
+  }
+
+  /* The longest checkpoint is reported for this run only. */
+  wal_stats_reset_max();
+  wal_stats_get(&wal0);
+  start = now_micros() * 1e-6;
+  if (with_writer)
+    pthread_create(&writer.thread_, NULL, writer_main, &writer);
+  for (i = 0; i < num_readers; i++)
+    pthread_create(&readers[i].thread_, NULL, reader_main, &readers[i]);
+
+  for (i = 0; i < num_readers; i++) {
+    pthread_join(readers[i].thread_, NULL);
+    for (k = 0; k < kNumReadKinds; k++)
+      for (p = 0; p < kNumReadPhases; p++)
+        histogram_merge(&stats->reads_[k][p], &readers[i].hist_[k][p]);
+    stats->num_reads_ += readers[i].num_reads_;
+    sqlite3_close(readers[i].db_);
+  }
+  if (with_writer)
+    pthread_join(writer.thread_, NULL);
+  stats->seconds_ = now_micros() * 1e-6 - start;
+  wal_stats_get(&wal1);
+
+  histogram_merge(&stats->commits_, &writer.commit_hist_);
+  stats->txns_ = writer.txns_;
+  stats->rows_ = writer.rows_;
+  stats->checkpoints_ = wal1.checkpoints_ - wal0.checkpoints_;
+  stats->checkpoint_nanos_ = wal1.checkpoint_nanos_ - wal0.checkpoint_nanos_;
+  stats->max_checkpoint_nanos_ = wal1.max_checkpoint_nanos_;
+  sqlite3_close(writer.db_);
+  free(writer.gen_.data_);
+  free(readers);
+}
+
+static void print_latency_row(const char *label, Histogram *h) {
+  if (h->num_ == 0)
+    return;
+  fprintf(stderr, "  %-18s %10.0f %10.3f %10.3f %10.3f %10.3f\n", label,
+          h->num_, histogram_percentile(h, 50), histogram_percentile(h, 99),
+          histogram_percentile(h, 99.9), h->max_);
+}
+
+void concurrent_print(ConcurrentStats *stats) {
+  char label[64];
+  int k, p;
+
+  fprintf(stderr, "  %-18s %10s %10s %10s %10s %10s\n", "read latency (us)",
+          "count", "p50", "p99", "p99.9", "max");
+  for (k = 0; k < kNumReadKinds; k++) {
+    for (p = 0; p < kNumReadPhases; p++) {
+      snprintf(label, sizeof(label), "%s/%s", read_kind_names[k],
+               read_phase_names[p]);
+      print_latency_row(label, &stats->reads_[k][p]);
+    }
+  }
+  print_latency_row("commit", &stats->commits_);
+  fprintf(stderr, "  Writer: %ld txns (%.1f/s), %ld rows; %ld checkpoints, "
+          "avg %.3f ms, max %.3f ms\n",
+          stats->txns_, stats->seconds_ > 0 ? stats->txns_ / stats->seconds_ : 0,
+          stats->rows_, stats->checkpoints_,
+          stats->checkpoints_ ? stats->checkpoint_nanos_ / 1e6 / stats->checkpoints_ : 0,
+          stats->max_checkpoint_nanos_ / 1e6);
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+/*
+ * Attach to a running db_bench started with --export_socket=PATH and
+ * print its live statistics.
+ *
+ *   db_bench_stat [--watch=SECS] [--match=TEXT] PATH
+ *
+ * --match keeps only the samples whose line contains TEXT; --watch
+ * repeats every SECS seconds until the benchmark goes away.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int scrape(const char *path, const char *match) {
+  struct sockaddr_un addr;
+  char line[1024];
+  FILE *f;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    perror(path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  /* An empty request asks for the bare text format. */
+  shutdown(fd, SHUT_WR);
+
+  f = fdopen(fd, "r");
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (match != NULL && (line[0] == '#' || strstr(line, match) == NULL))
+      continue;
+    fputs(line, stdout);
+  }
+  fclose(f);
+  fflush(stdout);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  const char *path = NULL, *match = NULL;
+  int watch = 0;
+  char junk;
+  int i, n;
+
+  for (i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--watch=%d%c", &n, &junk) == 1 && n > 0) {
+      watch = n;
+    } else if (!strncmp(argv[i], "--match=", strlen("--match="))) {
+      match = argv[i] + strlen("--match=");
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "usage: %s [--watch=SECS] [--match=TEXT] PATH\n",
+              argv[0]);
+      exit(2);
+    }
+  }
+  if (path == NULL) {
+    fprintf(stderr, "usage: %s [--watch=SECS] [--match=TEXT] PATH\n", argv[0]);
+    exit(2);
+  }
+
+  if (scrape(path, match) != 0)
+    exit(1);
+  while (watch > 0) {
+    sleep(watch);
+    printf("\n");
+    if (scrape(path, match) != 0)
+      break;
+  }
+
+  return 0;
+}
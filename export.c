@@ -0,0 +1,287 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Live statistics exporter. A thread listens on a Unix-domain socket and
+ * answers every connection with one snapshot in the Prometheus text
+ * format, then closes it. A client that sends an HTTP request gets an
+ * HTTP response, so "curl --unix-socket PATH http://localhost/metrics"
+ * and scrapers that speak HTTP over a socket work; db_bench_stat and
+ * anything else that just reads get the bare text. The benchmark thread
+ * publishes its counters and histograms every kExportPublishOps ops, so
+ * the exporter never reads state the benchmark is still updating.
+ */
+#define kExportPublishOps 256
+
+typedef struct ExportSnapshot {
+  char benchmark_[128];
+  char db_path_[1024];
+  long done_;
+  int64_t bytes_;
+  double start_;
+  bool running_;
+  Histogram rd_;
+  Histogram wr_;
+} ExportSnapshot;
+
+static pthread_t server_;
+static pthread_mutex_t mu_ = PTHREAD_MUTEX_INITIALIZER;
+static ExportSnapshot snap_;
+static char sock_path_[108];
+static int listen_fd_ = -1;
+static bool enabled_;
+
+bool export_enabled() {
+  return enabled_;
+}
+
+/* Name the benchmark that is about to run and the database it uses. */
+void export_benchmark(const char *name, const char *db_path) {
+  if (!enabled_)
+    return;
+  pthread_mutex_lock(&mu_);
+  snprintf(snap_.benchmark_, sizeof(snap_.benchmark_), "%s", name);
+  snprintf(snap_.db_path_, sizeof(snap_.db_path_), "%s",
+           db_path ? db_path : "");
+  pthread_mutex_unlock(&mu_);
+}
+
+/* Copy the measurement state; running is false once stop() has run. */
+void export_publish(long done, int64_t bytes, double start, bool running,
+                    const Histogram *rd, const Histogram *wr) {
+  if (!enabled_)
+    return;
+  pthread_mutex_lock(&mu_);
+  snap_.done_ = done;
+  snap_.bytes_ = bytes;
+  snap_.start_ = start;
+  snap_.running_ = running;
+  snap_.rd_ = *rd;
+  snap_.wr_ = *wr;
+  pthread_mutex_unlock(&mu_);
+}
+
+/* Publish from the per-op path only every kExportPublishOps ops. */
+void export_tick(long done, int64_t bytes, double start, const Histogram *rd,
+                 const Histogram *wr) {
+  if (enabled_ && done % kExportPublishOps == 0)
+    export_publish(done, bytes, start, true, rd, wr);
+}
+
+typedef struct Buf {
+  char *data_;
+  size_t len_;
+  size_t cap_;
+} Buf;
+
+static void buf_printf(Buf *b, const char *fmt, ...) {
+  va_list ap;
+  int n;
+
+  for (;;) {
+    va_start(ap, fmt);
+    n = vsnprintf(b->data_ + b->len_, b->cap_ - b->len_, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && (size_t)n < b->cap_ - b->len_)
+      break;
+    b->cap_ = b->cap_ * 2 + n;
+    b->data_ = realloc(b->data_, b->cap_);
+  }
+  b->len_ += n;
+}
+
+static void metric(Buf *b, const char *name, const char *type,
+                   const char *help) {
+  buf_printf(b, "# HELP sqlite_bench_%s %s\n", name, help);
+  buf_printf(b, "# TYPE sqlite_bench_%s %s\n", name, type);
+}
+
+/* Emit buckets up to the one holding the largest sample, then +Inf. */
+static void histogram_metric(Buf *b, const char *kind, const Histogram *h) {
+  double count = 0;
+  int i;
+
+  for (i = 0; i < kNumBuckets - 1 && count < h->num_; i++) {
+    count += h->buckets_[i];
+    buf_printf(b, "sqlite_bench_op_latency_microseconds_bucket"
+               "{kind=\"%s\",le=\"%g\"} %.0f\n",
+               kind, histogram_bucket_limit(i), count);
+  }
+  buf_printf(b, "sqlite_bench_op_latency_microseconds_bucket"
+             "{kind=\"%s\",le=\"+Inf\"} %.0f\n", kind, h->num_);
+  buf_printf(b, "sqlite_bench_op_latency_microseconds_sum{kind=\"%s\"} %.3f\n",
+             kind, h->sum_);
+  buf_printf(b, "sqlite_bench_op_latency_microseconds_count{kind=\"%s\"} %.0f\n",
+             kind, h->num_);
+}
+
+static int64_t path_size(const char *path) {
+  struct stat st;
+
+  return stat(path, &st) == 0 ? (int64_t)st.st_size : 0;
+}
+
+static void render(Buf *b) {
+  ExportSnapshot s;
+  IoStats io;
+  WalStats wal;
+  char wal_path[1100];
+  double elapsed;
+
+  pthread_mutex_lock(&mu_);
+  s = snap_;
+  pthread_mutex_unlock(&mu_);
+  memset(&io, 0, sizeof(io));
+  iostat_get(&io);
+  wal_stats_get(&wal);
+  snprintf(wal_path, sizeof(wal_path), "%s-wal", s.db_path_);
+  elapsed = s.running_ ? now_micros() * 1e-6 - s.start_ : 0;
+
+  metric(b, "info", "gauge", "Benchmark currently or last run.");
+  buf_printf(b, "sqlite_bench_info{benchmark=\"%s\"} 1\n", s.benchmark_);
+  metric(b, "running", "gauge", "1 while a benchmark is being measured.");
+  buf_printf(b, "sqlite_bench_running %d\n", s.running_);
+  metric(b, "ops_done", "gauge", "Operations completed by the benchmark.");
+  buf_printf(b, "sqlite_bench_ops_done %ld\n", s.done_);
+  metric(b, "bytes_done", "gauge", "Key and value bytes written or read.");
+  buf_printf(b, "sqlite_bench_bytes_done %" PRId64 "\n", s.bytes_);
+  metric(b, "elapsed_seconds", "gauge", "Time since the benchmark started.");
+  buf_printf(b, "sqlite_bench_elapsed_seconds %.3f\n", elapsed);
+  metric(b, "ops_per_second", "gauge", "Mean throughput of the benchmark.");
+  buf_printf(b, "sqlite_bench_ops_per_second %.1f\n",
+             elapsed > 0 ? s.done_ / elapsed : 0.0);
+
+  metric(b, "op_latency_microseconds", "histogram",
+         "Latency of each read and write operation.");
+  histogram_metric(b, "read", &s.rd_);
+  histogram_metric(b, "write", &s.wr_);
+
+  metric(b, "db_file_bytes", "gauge", "Size of the main database file.");
+  buf_printf(b, "sqlite_bench_db_file_bytes %" PRId64 "\n",
+             path_size(s.db_path_));
+  metric(b, "wal_file_bytes", "gauge", "Size of the write-ahead log.");
+  buf_printf(b, "sqlite_bench_wal_file_bytes %" PRId64 "\n",
+             path_size(wal_path));
+  metric(b, "checkpoint_running", "gauge",
+         "1 while a hook-driven WAL checkpoint is in progress.");
+  buf_printf(b, "sqlite_bench_checkpoint_running %d\n",
+             (int)(wal_checkpoint_seq() & 1));
+  metric(b, "checkpoints_total", "counter", "Hook-driven WAL checkpoints.");
+  buf_printf(b, "sqlite_bench_checkpoints_total %" PRIu64 "\n",
+             wal.checkpoints_);
+  metric(b, "checkpoint_frames_total", "counter",
+         "WAL frames copied back by checkpoints.");
+  buf_printf(b, "sqlite_bench_checkpoint_frames_total %" PRIu64 "\n",
+             wal.frames_);
+  metric(b, "checkpoint_seconds_total", "counter", "Time spent checkpointing.");
+  buf_printf(b, "sqlite_bench_checkpoint_seconds_total %.6f\n",
+             wal.checkpoint_nanos_ * 1e-9);
+
+  metric(b, "vfs_reads_total", "counter", "xRead calls.");
+  buf_printf(b, "sqlite_bench_vfs_reads_total %" PRIu64 "\n", io.reads_);
+  metric(b, "vfs_read_bytes_total", "counter", "Bytes read through xRead.");
+  buf_printf(b, "sqlite_bench_vfs_read_bytes_total %" PRIu64 "\n",
+             io.read_bytes_);
+  metric(b, "vfs_writes_total", "counter", "xWrite calls.");
+  buf_printf(b, "sqlite_bench_vfs_writes_total %" PRIu64 "\n", io.writes_);
+  metric(b, "vfs_write_bytes_total", "counter", "Bytes written through xWrite.");
+  buf_printf(b, "sqlite_bench_vfs_write_bytes_total %" PRIu64 "\n",
+             io.write_bytes_);
+  metric(b, "vfs_syncs_total", "counter", "xSync calls.");
+  buf_printf(b, "sqlite_bench_vfs_syncs_total %" PRIu64 "\n", io.syncs_);
+  metric(b, "vfs_fetches_total", "counter", "Pages served from the mmap region.");
+  buf_printf(b, "sqlite_bench_vfs_fetches_total %" PRIu64 "\n", io.fetches_);
+}
+
+/* Answer one connection; HTTP clients get a status line and headers. */
+static void serve(int fd) {
+  Buf b = { NULL, 0, 0 };
+  char req[512];
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  ssize_t n = 0, w;
+  size_t off;
+  bool http;
+
+  if (poll(&pfd, 1, 100) > 0)
+    n = read(fd, req, sizeof(req) - 1);
+  http = n >= 4 && !strncmp(req, "GET ", 4);
+
+  b.cap_ = 16384;
+  b.data_ = malloc(b.cap_);
+  render(&b);
+  if (http) {
+    snprintf(req, sizeof(req), "HTTP/1.0 200 OK\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %zu\r\n\r\n", b.len_);
+    if (write(fd, req, strlen(req)) < 0)
+      goto out;
+  }
+  for (off = 0; off < b.len_; off += w)
+    if ((w = write(fd, b.data_ + off, b.len_ - off)) <= 0)
+      break;
+out:
+  free(b.data_);
+}
+
+static void* server_main(void *arg) {
+  int fd;
+
+  for (;;) {
+    fd = accept(listen_fd_, NULL, NULL);
+    if (fd < 0)
+      continue;
+    serve(fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+static void export_unlink(void) {
+  unlink(sock_path_);
+}
+
+/* Listen on path and start the server thread. */
+void export_init(const char *path) {
+  struct sockaddr_un addr;
+
+  if (path == NULL || enabled_)
+    return;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "export socket path too long: %s\n", path);
+    exit(1);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  strcpy(sock_path_, path);
+  unlink(path);
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0 ||
+      bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listen_fd_, 16) != 0) {
+    perror("export socket");
+    exit(1);
+  }
+  atexit(export_unlink);
+
+  /* Writing to a scraper that hung up must not kill the benchmark. */
+  signal(SIGPIPE, SIG_IGN);
+  enabled_ = true;
+  if (pthread_create(&server_, NULL, server_main, NULL) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+  pthread_detach(server_);
+}
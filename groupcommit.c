@@ -0,0 +1,256 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * Application-level group commit. Client threads queue write requests and
+ * block; a single committer thread waits until FLAGS_group_commit_max
+ * requests are pending or the oldest has waited FLAGS_group_commit_wait_us,
+ * applies the batch in one transaction, commits once and wakes the
+ * clients. The committer owns the benchmark's connection for the run.
+ */
+typedef struct Request {
+  struct Request *next_;
+  long key_;
+  const char *value_;
+  int value_size_;
+  uint64_t submit_nanos_;
+  bool done_;
+} Request;
+
+typedef struct GroupCommit {
+  pthread_mutex_t mu_;
+  pthread_cond_t pending_cv_;
+  pthread_cond_t done_cv_;
+  Request *head_;
+  Request *tail_;
+  int num_pending_;
+  bool shutdown_;
+
+  sqlite3 *db_;
+  sqlite3_stmt *begin_;
+  sqlite3_stmt *commit_;
+  sqlite3_stmt *replace_;
+  long batches_;
+  long max_batch_;
+} GroupCommit;
+
+typedef struct Client {
+  pthread_t thread_;
+  int thread_num_;
+  GroupCommit *gc_;
+  Random rand_;
+  RandomGenerator gen_;
+  ValueSizeDist *dist_;
+  long num_entries_;
+  long num_requests_;
+  /* With --unique_keys, client i writes keys first_, first_ + 1, ... of perm_. */
+  const Permutation *perm_;
+  long first_;
+  Histogram hist_;
+} Client;
+
+static void gc_step(GroupCommit *gc, sqlite3_stmt *stmt) {
+  int status = sqlite3_step(stmt);
+
+  if (status != SQLITE_DONE) {
+    fprintf(stderr, "SQL step error: %s\n", sqlite3_errmsg(gc->db_));
+    exit(1);
+  }
+  sqlite3_reset(stmt);
+}
+
+static void gc_apply(GroupCommit *gc, Request *batch) {
+  char key[100];
+  Request *r;
+
+  gc_step(gc, gc->begin_);
+  for (r = batch; r != NULL; r = r->next_) {
+    bind_key(gc->replace_, 1, key, r->key_);
+    sqlite3_bind_blob(gc->replace_, 2, r->value_, r->value_size_,
+                      SQLITE_STATIC);
+    gc_step(gc, gc->replace_);
+  }
+  gc_step(gc, gc->commit_);
+}
+
+static void* committer_main(void *arg) {
+  GroupCommit *gc = arg;
+  Request *batch, *last, *r;
+  struct timespec deadline;
+  uint64_t wake, now;
+  int n;
+
+  affinity_pin(1);
+  pthread_mutex_lock(&gc->mu_);
+  for (;;) {
+    while (gc->num_pending_ == 0 && !gc->shutdown_)
+      pthread_cond_wait(&gc->pending_cv_, &gc->mu_);
+    if (gc->num_pending_ == 0)
+      break;
+
+    /* Give other clients until the oldest request's deadline to join. */
+    wake = gc->head_->submit_nanos_ + (uint64_t)FLAGS_group_commit_wait_us * 1000;
+    while (gc->num_pending_ < FLAGS_group_commit_max && !gc->shutdown_) {
+      now = now_nanos();
+      if (now >= wake)
+        break;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += (wake - now) / 1000000000;
+      deadline.tv_nsec += (wake - now) % 1000000000;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000;
+      deadline.tv_nsec %= 1000000000;
+      pthread_cond_timedwait(&gc->pending_cv_, &gc->mu_, &deadline);
+    }
+
+    /* Take up to group_commit_max requests off the queue. */
+    batch = gc->head_;
+    last = batch;
+    for (n = 1; n < FLAGS_group_commit_max && last->next_ != NULL; n++)
+      last = last->next_;
+    gc->head_ = last->next_;
+    if (gc->head_ == NULL)
+      gc->tail_ = NULL;
+    last->next_ = NULL;
+    gc->num_pending_ -= n;
+    pthread_mutex_unlock(&gc->mu_);
+
+    gc_apply(gc, batch);
+
+    pthread_mutex_lock(&gc->mu_);
+    for (r = batch; r != NULL; r = r->next_)
+      r->done_ = true;
+    gc->batches_++;
+    if (n > gc->max_batch_)
+      gc->max_batch_ = n;
+    pthread_cond_broadcast(&gc->done_cv_);
+  }
+  pthread_mutex_unlock(&gc->mu_);
+
+  return NULL;
+}
+
+static void gc_submit(GroupCommit *gc, Request *r) {
+  r->next_ = NULL;
+  r->done_ = false;
+  r->submit_nanos_ = now_nanos();
+
+  pthread_mutex_lock(&gc->mu_);
+  if (gc->tail_ == NULL) {
+    gc->head_ = r;
+  } else {
+    gc->tail_->next_ = r;
+  }
+  gc->tail_ = r;
+  gc->num_pending_++;
+  if (gc->num_pending_ == 1 || gc->num_pending_ >= FLAGS_group_commit_max)
+    pthread_cond_signal(&gc->pending_cv_);
+
+  while (!r->done_)
+    pthread_cond_wait(&gc->done_cv_, &gc->mu_);
+  pthread_mutex_unlock(&gc->mu_);
+}
+
+static void* client_main(void *arg) {
+  Client *c = arg;
+  Request r;
+  uint64_t t0;
+  const char *value;
+  long i;
+
+  affinity_pin(c->thread_num_);
+  for (i = 0; i < c->num_requests_ && !deadline_passed(); i++) {
+    r.key_ = c->perm_ != NULL ?
+             perm_at(c->perm_, (c->first_ + i) % c->num_entries_) :
+                                rand_key(&c->rand_, c->num_entries_);
+    r.value_size_ = value_dist_next(c->dist_, &c->rand_);
+    value = rand_gen_generate(&c->gen_, r.value_size_);
+    r.value_ = value;
+
+    t0 = now_nanos();
+    gc_submit(c->gc_, &r);
+    histogram_add(&c->hist_, (now_nanos() - t0) / 1e3);
+  }
+  c->num_requests_ = i;
+
+  return NULL;
+}
+
+static sqlite3_stmt* gc_prepare(sqlite3 *db, const char *sql) {
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "prepare error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+
+  return stmt;
+}
+
+void groupcommit_run(sqlite3 *db, int num_clients, long num_requests,
+                     long num_entries, ValueSizeDist *dist,
+                     GroupCommitStats *stats) {
+  Client *clients = calloc(num_clients, sizeof(Client));
+  pthread_t committer;
+  GroupCommit gc;
+  Permutation perm;
+  IoStats io0, io1;
+  int i;
+
+  memset(&gc, 0, sizeof(gc));
+  pthread_mutex_init(&gc.mu_, NULL);
+  pthread_cond_init(&gc.pending_cv_, NULL);
+  pthread_cond_init(&gc.done_cv_, NULL);
+  gc.db_ = db;
+  gc.begin_ = gc_prepare(db, "BEGIN");
+  gc.commit_ = gc_prepare(db, "COMMIT");
+  gc.replace_ = gc_prepare(db, "REPLACE INTO test (key, value) VALUES (?, ?)");
+
+  memset(stats, 0, sizeof(*stats));
+  histogram_clear(&stats->latency_);
+  perm_init(&perm, num_entries, 301);
+  for (i = 0; i < num_clients; i++) {
+    clients[i].gc_ = &gc;
+    clients[i].thread_num_ = 2 + i;
+    clients[i].dist_ = dist;
+    clients[i].num_entries_ = num_entries;
+    clients[i].num_requests_ = num_requests / num_clients;
+    clients[i].perm_ = FLAGS_unique_keys ? &perm : NULL;
+    clients[i].first_ = i * clients[i].num_requests_;
+    rand_seed(&clients[i].rand_, 3000, i);
+    rand_gen_init(&clients[i].gen_, FLAGS_compression_ratio);
+    histogram_clear(&clients[i].hist_);
+  }
+
+  iostat_get(&io0);
+  pthread_create(&committer, NULL, committer_main, &gc);
+  for (i = 0; i < num_clients; i++)
+    pthread_create(&clients[i].thread_, NULL, client_main, &clients[i]);
+  for (i = 0; i < num_clients; i++) {
+    pthread_join(clients[i].thread_, NULL);
+    histogram_merge(&stats->latency_, &clients[i].hist_);
+    stats->requests_ += clients[i].num_requests_;
+    free(clients[i].gen_.data_);
+  }
+
+  pthread_mutex_lock(&gc.mu_);
+  gc.shutdown_ = true;
+  pthread_cond_signal(&gc.pending_cv_);
+  pthread_mutex_unlock(&gc.mu_);
+  pthread_join(committer, NULL);
+  iostat_get(&io1);
+
+  stats->batches_ = gc.batches_;
+  stats->max_batch_ = gc.max_batch_;
+  stats->syncs_ = io1.syncs_ - io0.syncs_;
+
+  sqlite3_finalize(gc.begin_);
+  sqlite3_finalize(gc.commit_);
+  sqlite3_finalize(gc.replace_);
+  pthread_cond_destroy(&gc.pending_cv_);
+  pthread_cond_destroy(&gc.done_cv_);
+  pthread_mutex_destroy(&gc.mu_);
+  free(clients);
+}
@@ -50,6 +50,15 @@ static double percentile(Histogram* hist_, double p) {
   return hist_->max_;
 }
 
+double histogram_percentile(Histogram* hist_, double p) {
+  return percentile(hist_, p);
+}
+
+/* Upper bound, in microseconds, of bucket b. */
+double histogram_bucket_limit(int b) {
+  return bucket_limit[b];
+}
+
 static double average(Histogram* hist_) {
   return (hist_->num_ == 0.0) ? 0 : hist_->sum_ / hist_->num_;
 }
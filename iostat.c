@@ -0,0 +1,369 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * A pass-through VFS that counts the calls SQLite makes into the OS
+ * layer. When a benchmark or option reports its counters, it is
+ * registered as the default so every database opened by the benchmark
+ * goes through it; otherwise SQLite talks to the OS directly.
+ * xRead/xWrite map one to one onto pread and pwrite; xFetch calls that
+ * return a page are served from the mmap region without a system call.
+ * With --madvise, the mapped region is advised whenever SQLite maps it
+ * at a new address. Temporary files (sorter
+ * spills, temp tables and temp indexes) are also counted on their own.
+ */
+#define kTempFileFlags (SQLITE_OPEN_TEMP_DB | SQLITE_OPEN_TEMP_JOURNAL | \
+                        SQLITE_OPEN_TRANSIENT_DB | SQLITE_OPEN_SUBJOURNAL)
+
+typedef struct IostatFile {
+  sqlite3_file base_;
+  sqlite3_file *real_;
+  char *map_base_;
+  sqlite3_int64 map_limit_;
+  bool temp_;
+} IostatFile;
+
+static sqlite3_vfs iostat_vfs_;
+static sqlite3_vfs *real_vfs_;
+static IoStats io_stats_;
+static int madvise_advice_ = -1;
+static bool time_io_;
+static bool iostat_installed_;
+
+#define COUNT(field, n) __atomic_fetch_add(&io_stats_.field, (n), __ATOMIC_RELAXED)
+
+#define REAL(f) (((IostatFile *)(f))->real_)
+
+static int iostat_close(sqlite3_file *f) {
+  int rc = REAL(f)->pMethods->xClose(REAL(f));
+
+  COUNT(other_, 1);
+  return rc;
+}
+
+static int iostat_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 ofst) {
+  COUNT(reads_, 1);
+  COUNT(read_bytes_, amt);
+  if (((IostatFile *)f)->temp_) {
+    COUNT(temp_reads_, 1);
+    COUNT(temp_read_bytes_, amt);
+  }
+  return REAL(f)->pMethods->xRead(REAL(f), buf, amt, ofst);
+}
+
+static int iostat_write(sqlite3_file *f, const void *buf, int amt,
+                        sqlite3_int64 ofst) {
+  uint64_t t0 = time_io_ ? now_nanos() : 0;
+  int rc = REAL(f)->pMethods->xWrite(REAL(f), buf, amt, ofst);
+
+  COUNT(writes_, 1);
+  COUNT(write_bytes_, amt);
+  if (time_io_)
+    COUNT(write_nanos_, now_nanos() - t0);
+  if (((IostatFile *)f)->temp_) {
+    COUNT(temp_writes_, 1);
+    COUNT(temp_write_bytes_, amt);
+  }
+  return rc;
+}
+
+static int iostat_truncate(sqlite3_file *f, sqlite3_int64 size) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xTruncate(REAL(f), size);
+}
+
+static int iostat_sync(sqlite3_file *f, int flags) {
+  uint64_t t0 = time_io_ ? now_nanos() : 0;
+  int rc = REAL(f)->pMethods->xSync(REAL(f), flags);
+
+  COUNT(syncs_, 1);
+  if (time_io_)
+    COUNT(sync_nanos_, now_nanos() - t0);
+  return rc;
+}
+
+static int iostat_file_size(sqlite3_file *f, sqlite3_int64 *size) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xFileSize(REAL(f), size);
+}
+
+static int iostat_lock(sqlite3_file *f, int lock) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xLock(REAL(f), lock);
+}
+
+static int iostat_unlock(sqlite3_file *f, int lock) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xUnlock(REAL(f), lock);
+}
+
+static int iostat_check_reserved_lock(sqlite3_file *f, int *out) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xCheckReservedLock(REAL(f), out);
+}
+
+static int iostat_file_control(sqlite3_file *f, int op, void *arg) {
+  IostatFile *file = (IostatFile *)f;
+  bool set_limit = op == SQLITE_FCNTL_MMAP_SIZE && *(sqlite3_int64 *)arg >= 0;
+  int rc = REAL(f)->pMethods->xFileControl(REAL(f), op, arg);
+
+  /* Reread the limit after a change; the real file may clamp it. */
+  if (set_limit && rc == SQLITE_OK) {
+    file->map_limit_ = -1;
+    REAL(f)->pMethods->xFileControl(REAL(f), op, &file->map_limit_);
+  }
+  return rc;
+}
+
+static int iostat_sector_size(sqlite3_file *f) {
+  return REAL(f)->pMethods->xSectorSize(REAL(f));
+}
+
+static int iostat_device_characteristics(sqlite3_file *f) {
+  return REAL(f)->pMethods->xDeviceCharacteristics(REAL(f));
+}
+
+static int iostat_shm_map(sqlite3_file *f, int region, int size, int extend,
+                          void volatile **p) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xShmMap(REAL(f), region, size, extend, p);
+}
+
+static int iostat_shm_lock(sqlite3_file *f, int offset, int n, int flags) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xShmLock(REAL(f), offset, n, flags);
+}
+
+static void iostat_shm_barrier(sqlite3_file *f) {
+  REAL(f)->pMethods->xShmBarrier(REAL(f));
+}
+
+static int iostat_shm_unmap(sqlite3_file *f, int delete_flag) {
+  COUNT(other_, 1);
+  return REAL(f)->pMethods->xShmUnmap(REAL(f), delete_flag);
+}
+
+/* Advise the whole mapping once each time SQLite maps or moves it. */
+static void iostat_advise(IostatFile *file, char *base) {
+  sqlite3_int64 size = 0;
+
+  file->map_base_ = base;
+  file->real_->pMethods->xFileSize(file->real_, &size);
+  if (file->map_limit_ >= 0 && file->map_limit_ < size)
+    size = file->map_limit_;
+  if (size > 0 && madvise(base, size, madvise_advice_) != 0)
+    perror("madvise");
+}
+
+static int iostat_fetch(sqlite3_file *f, sqlite3_int64 ofst, int amt,
+                        void **p) {
+  int rc = REAL(f)->pMethods->xFetch(REAL(f), ofst, amt, p);
+
+  if (*p != NULL) {
+    COUNT(fetches_, 1);
+    if (madvise_advice_ >= 0 &&
+        (char *)*p - ofst != ((IostatFile *)f)->map_base_)
+      iostat_advise((IostatFile *)f, (char *)*p - ofst);
+  } else {
+    COUNT(fetch_misses_, 1);
+  }
+  return rc;
+}
+
+static int iostat_unfetch(sqlite3_file *f, sqlite3_int64 ofst, void *p) {
+  return REAL(f)->pMethods->xUnfetch(REAL(f), ofst, p);
+}
+
+static const sqlite3_io_methods iostat_io_methods_v3_ = {
+  3,
+  iostat_close,
+  iostat_read,
+  iostat_write,
+  iostat_truncate,
+  iostat_sync,
+  iostat_file_size,
+  iostat_lock,
+  iostat_unlock,
+  iostat_check_reserved_lock,
+  iostat_file_control,
+  iostat_sector_size,
+  iostat_device_characteristics,
+  iostat_shm_map,
+  iostat_shm_lock,
+  iostat_shm_barrier,
+  iostat_shm_unmap,
+  iostat_fetch,
+  iostat_unfetch,
+};
+
+/* One table per version, so a file never advertises calls it lacks. */
+static sqlite3_io_methods iostat_io_methods_[3];
+
+static int iostat_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *f,
+                       int flags, int *out_flags) {
+  IostatFile *file = (IostatFile *)f;
+  int rc, version;
+
+  file->real_ = (sqlite3_file *)&file[1];
+  file->map_base_ = NULL;
+  file->map_limit_ = -1;
+  file->temp_ = (flags & kTempFileFlags) != 0;
+  rc = real_vfs_->xOpen(real_vfs_, name, file->real_, flags, out_flags);
+  COUNT(other_, 1);
+  if (file->temp_)
+    COUNT(temp_opens_, 1);
+  /* Only hand out our methods if the real file is open. */
+  f->pMethods = NULL;
+  if (file->real_->pMethods != NULL) {
+    version = file->real_->pMethods->iVersion;
+    if (version > 3)
+      version = 3;
+    f->pMethods = &iostat_io_methods_[version - 1];
+    /* A negative limit reads the mmap limit without changing it. */
+    if (version >= 3)
+      file->real_->pMethods->xFileControl(file->real_,
+                                          SQLITE_FCNTL_MMAP_SIZE,
+                                          &file->map_limit_);
+  }
+
+  return rc;
+}
+
+static int iostat_delete(sqlite3_vfs *vfs, const char *name, int sync_dir) {
+  COUNT(other_, 1);
+  return real_vfs_->xDelete(real_vfs_, name, sync_dir);
+}
+
+static int iostat_access(sqlite3_vfs *vfs, const char *name, int flags,
+                         int *out) {
+  COUNT(other_, 1);
+  return real_vfs_->xAccess(real_vfs_, name, flags, out);
+}
+
+static int iostat_full_pathname(sqlite3_vfs *vfs, const char *name, int n,
+                                char *out) {
+  return real_vfs_->xFullPathname(real_vfs_, name, n, out);
+}
+
+static void* iostat_dl_open(sqlite3_vfs *vfs, const char *path) {
+  return real_vfs_->xDlOpen(real_vfs_, path);
+}
+
+static void iostat_dl_error(sqlite3_vfs *vfs, int n, char *msg) {
+  real_vfs_->xDlError(real_vfs_, n, msg);
+}
+
+static void (*iostat_dl_sym(sqlite3_vfs *vfs, void *h, const char *sym))(void) {
+  return real_vfs_->xDlSym(real_vfs_, h, sym);
+}
+
+static void iostat_dl_close(sqlite3_vfs *vfs, void *h) {
+  real_vfs_->xDlClose(real_vfs_, h);
+}
+
+static int iostat_randomness(sqlite3_vfs *vfs, int n, char *out) {
+  return real_vfs_->xRandomness(real_vfs_, n, out);
+}
+
+static int iostat_sleep(sqlite3_vfs *vfs, int micros) {
+  return real_vfs_->xSleep(real_vfs_, micros);
+}
+
+static int iostat_current_time(sqlite3_vfs *vfs, double *out) {
+  return real_vfs_->xCurrentTime(real_vfs_, out);
+}
+
+static int iostat_get_last_error(sqlite3_vfs *vfs, int n, char *out) {
+  return real_vfs_->xGetLastError(real_vfs_, n, out);
+}
+
+static int iostat_current_time_int64(sqlite3_vfs *vfs, sqlite3_int64 *out) {
+  return real_vfs_->xCurrentTimeInt64(real_vfs_, out);
+}
+
+static int parse_advice(const char *name) {
+  if (name == NULL)
+    return -1;
+  if (!strcasecmp(name, "NORMAL"))
+    return MADV_NORMAL;
+  if (!strcasecmp(name, "RANDOM"))
+    return MADV_RANDOM;
+  if (!strcasecmp(name, "SEQUENTIAL"))
+    return MADV_SEQUENTIAL;
+  if (!strcasecmp(name, "WILLNEED"))
+    return MADV_WILLNEED;
+
+  fprintf(stderr, "unknown madvise hint '%s'\n", name);
+  exit(1);
+}
+
+/* Must run before the first database is opened. */
+void iostat_init(const char *advice) {
+  int i;
+
+  madvise_advice_ = parse_advice(advice);
+  /* Only the phase and slow op reports use write and sync times. */
+  time_io_ = FLAGS_phase_stats || FLAGS_slow_op_us > 0;
+  if (iostat_installed_)
+    return;
+
+  real_vfs_ = sqlite3_vfs_find(NULL);
+  if (real_vfs_ == NULL || real_vfs_->iVersion < 2)
+    return;
+
+  iostat_vfs_.iVersion = 2;
+  iostat_vfs_.szOsFile = sizeof(IostatFile) + real_vfs_->szOsFile;
+  iostat_vfs_.mxPathname = real_vfs_->mxPathname;
+  iostat_vfs_.zName = "iostat";
+  iostat_vfs_.xOpen = iostat_open;
+  iostat_vfs_.xDelete = iostat_delete;
+  iostat_vfs_.xAccess = iostat_access;
+  iostat_vfs_.xFullPathname = iostat_full_pathname;
+  iostat_vfs_.xDlOpen = iostat_dl_open;
+  iostat_vfs_.xDlError = iostat_dl_error;
+  iostat_vfs_.xDlSym = iostat_dl_sym;
+  iostat_vfs_.xDlClose = iostat_dl_close;
+  iostat_vfs_.xRandomness = iostat_randomness;
+  iostat_vfs_.xSleep = iostat_sleep;
+  iostat_vfs_.xCurrentTime = iostat_current_time;
+  iostat_vfs_.xGetLastError = iostat_get_last_error;
+  iostat_vfs_.xCurrentTimeInt64 = iostat_current_time_int64;
+
+  for (i = 0; i < 3; i++) {
+    iostat_io_methods_[i] = iostat_io_methods_v3_;
+    iostat_io_methods_[i].iVersion = i + 1;
+    if (i < 1) {
+      iostat_io_methods_[i].xShmMap = NULL;
+      iostat_io_methods_[i].xShmLock = NULL;
+      iostat_io_methods_[i].xShmBarrier = NULL;
+      iostat_io_methods_[i].xShmUnmap = NULL;
+    }
+    if (i < 2) {
+      iostat_io_methods_[i].xFetch = NULL;
+      iostat_io_methods_[i].xUnfetch = NULL;
+    }
+  }
+
+  iostat_installed_ = sqlite3_vfs_register(&iostat_vfs_, 1) == SQLITE_OK;
+}
+
+void iostat_get(IoStats *stats) {
+  stats->reads_ = __atomic_load_n(&io_stats_.reads_, __ATOMIC_RELAXED);
+  stats->read_bytes_ = __atomic_load_n(&io_stats_.read_bytes_, __ATOMIC_RELAXED);
+  stats->writes_ = __atomic_load_n(&io_stats_.writes_, __ATOMIC_RELAXED);
+  stats->write_bytes_ = __atomic_load_n(&io_stats_.write_bytes_, __ATOMIC_RELAXED);
+  stats->write_nanos_ = __atomic_load_n(&io_stats_.write_nanos_, __ATOMIC_RELAXED);
+  stats->syncs_ = __atomic_load_n(&io_stats_.syncs_, __ATOMIC_RELAXED);
+  stats->sync_nanos_ = __atomic_load_n(&io_stats_.sync_nanos_, __ATOMIC_RELAXED);
+  stats->other_ = __atomic_load_n(&io_stats_.other_, __ATOMIC_RELAXED);
+  stats->fetches_ = __atomic_load_n(&io_stats_.fetches_, __ATOMIC_RELAXED);
+  stats->fetch_misses_ = __atomic_load_n(&io_stats_.fetch_misses_, __ATOMIC_RELAXED);
+  stats->temp_opens_ = __atomic_load_n(&io_stats_.temp_opens_, __ATOMIC_RELAXED);
+  stats->temp_reads_ = __atomic_load_n(&io_stats_.temp_reads_, __ATOMIC_RELAXED);
+  stats->temp_read_bytes_ = __atomic_load_n(&io_stats_.temp_read_bytes_, __ATOMIC_RELAXED);
+  stats->temp_writes_ = __atomic_load_n(&io_stats_.temp_writes_, __ATOMIC_RELAXED);
+  stats->temp_write_bytes_ = __atomic_load_n(&io_stats_.temp_write_bytes_, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,248 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * JSON document workload. Documents go into their own table,
+ * docs(id INTEGER PRIMARY KEY, doc), next to the key-value test table.
+ * Document k has FLAGS_json_fields fields per object, cycling through
+ * string, integer, real and boolean, and a "child" object nested
+ * FLAGS_json_depth levels deep. The innermost object holds "ref": k, the
+ * key that lookups search for by path. Strings are cut from a
+ * RandomGenerator and share the requested value size between them.
+ *
+ * --json_storage=jsonb stores the jsonb() encoding instead of text, so
+ * json_extract and jsonb_set work on the binary form without parsing it.
+ * --json_index picks how lookups find ref: an index on the json_extract
+ * expression itself, or an index on a VIRTUAL or STORED generated column.
+ */
+#define kJsonUpdatePath "$.f1"
+
+enum JsonIndex {
+  JSON_INDEX_EXPRESSION,
+  JSON_INDEX_VIRTUAL,
+  JSON_INDEX_STORED
+};
+
+static const char *index_names[] = { "expression", "virtual", "stored" };
+
+static int index_;
+static bool jsonb_;
+static char ref_path_[256];
+static sqlite3_stmt *stmts_[kNumJsonStmts];
+static RandomGenerator gen_;
+static char *doc_;
+static size_t doc_cap_;
+static size_t doc_len_;
+
+/* Check --json_storage and --json_index; false if SQLite lacks JSONB. */
+bool json_init() {
+  size_t i;
+  int d;
+
+  if (!strcasecmp(FLAGS_json_storage, "jsonb")) {
+    jsonb_ = true;
+  } else if (!strcasecmp(FLAGS_json_storage, "text")) {
+    jsonb_ = false;
+  } else {
+    fprintf(stderr, "unknown JSON storage '%s'\n", FLAGS_json_storage);
+    exit(1);
+  }
+
+  index_ = -1;
+  for (i = 0; i < sizeof(index_names) / sizeof(index_names[0]); i++)
+    if (!strcasecmp(FLAGS_json_index, index_names[i]))
+      index_ = i;
+  if (index_ < 0) {
+    fprintf(stderr, "unknown JSON index '%s'\n", FLAGS_json_index);
+    exit(1);
+  }
+
+  strcpy(ref_path_, "$");
+  for (d = 0; d < FLAGS_json_depth; d++)
+    strcat(ref_path_, ".child");
+  strcat(ref_path_, ".ref");
+
+  if (gen_.data_ == NULL)
+    rand_gen_init(&gen_, FLAGS_compression_ratio);
+
+  /* jsonb() and jsonb_set() arrived in 3.45.0. */
+  return !jsonb_ || sqlite3_libversion_number() >= 3045000;
+}
+
+const char* json_storage_name() {
+  return jsonb_ ? "jsonb" : "text";
+}
+
+const char* json_index_name() {
+  return index_names[index_];
+}
+
+static void doc_append(const char *s, size_t len) {
+  if (doc_len_ + len + 1 > doc_cap_) {
+    doc_cap_ = (doc_len_ + len + 1) * 2;
+    doc_ = realloc(doc_, doc_cap_);
+  }
+  memcpy(doc_ + doc_len_, s, len);
+  doc_len_ += len;
+  doc_[doc_len_] = '\0';
+}
+
+/* Append len generated characters, with the two that need escaping swapped. */
+static void doc_string(int len) {
+  const char *s = rand_gen_generate(&gen_, len);
+  size_t start = doc_len_;
+  int i;
+
+  doc_append("\"", 1);
+  doc_append(s, len);
+  for (i = 1; i <= len; i++)
+    if (doc_[start + i] == '"' || doc_[start + i] == '\\')
+      doc_[start + i] = '_';
+  doc_append("\"", 1);
+}
+
+static void doc_object(Random *rnd, long key, int depth, int str_len) {
+  char buf[64];
+  int i, n;
+
+  doc_append("{", 1);
+  for (i = 0; i < FLAGS_json_fields; i++) {
+    n = snprintf(buf, sizeof(buf), "\"f%d\":", i);
+    doc_append(buf, n);
+    switch (i % 4) {
+    case 0:
+      doc_string(str_len);
+      break;
+    case 1:
+      n = snprintf(buf, sizeof(buf), "%u", rand_next(rnd));
+      doc_append(buf, n);
+      break;
+    case 2:
+      n = snprintf(buf, sizeof(buf), "%.3f",
+                   rand_uniform(rnd, 1000000) / 7.0);
+      doc_append(buf, n);
+      break;
+    case 3:
+      if (rand_next(rnd) & 1)
+        doc_append("true", 4);
+      else
+        doc_append("false", 5);
+      break;
+    }
+    doc_append(",", 1);
+  }
+  if (depth < FLAGS_json_depth) {
+    doc_append("\"child\":", 8);
+    doc_object(rnd, key, depth + 1, str_len);
+  } else {
+    n = snprintf(buf, sizeof(buf), "\"ref\":%ld", key);
+    doc_append(buf, n);
+  }
+  doc_append("}", 1);
+}
+
+/* Document for key, with about size bytes of string fields. */
+const char* json_generate(Random *rnd, long key, int size, int *len) {
+  int num_strings = ((FLAGS_json_fields + 3) / 4) * (FLAGS_json_depth + 1);
+
+  doc_len_ = 0;
+  doc_object(rnd, key, 0, num_strings > 0 ? size / num_strings : 0);
+  *len = doc_len_;
+
+  return doc_;
+}
+
+static void exec_sql(sqlite3 *db, const char *sql) {
+  char *err_msg = NULL;
+
+  if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", err_msg);
+    exit(1);
+  }
+}
+
+/* Drop and recreate docs with the configured storage and index. */
+void json_create(sqlite3 *db) {
+  char sql[1024];
+
+  json_finalize();
+  exec_sql(db, "DROP TABLE IF EXISTS docs");
+  if (index_ == JSON_INDEX_EXPRESSION) {
+    snprintf(sql, sizeof(sql), "CREATE TABLE docs (id INTEGER PRIMARY KEY, "
+             "doc %s NOT NULL); CREATE INDEX docs_ref ON docs "
+             "(json_extract(doc, '%s'))", jsonb_ ? "BLOB" : "TEXT", ref_path_);
+  } else {
+    snprintf(sql, sizeof(sql), "CREATE TABLE docs (id INTEGER PRIMARY KEY, "
+             "doc %s NOT NULL, ref INTEGER AS (json_extract(doc, '%s')) %s); "
+             "CREATE INDEX docs_ref ON docs (ref)", jsonb_ ? "BLOB" : "TEXT",
+             ref_path_, index_ == JSON_INDEX_STORED ? "STORED" : "VIRTUAL");
+  }
+  exec_sql(db, sql);
+}
+
+/* Number of documents in docs, or -1 if there is no such table. */
+long json_count(sqlite3 *db) {
+  sqlite3_stmt *stmt;
+  long n = -1;
+
+  if (sqlite3_prepare_v2(db, "SELECT count(*) FROM docs", -1, &stmt,
+                         NULL) != SQLITE_OK)
+    return -1;
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    n = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return n;
+}
+
+/*
+ * Statements on docs. Lookups return the document as text, so a jsonb
+ * row pays for its conversion back the way an application would.
+ */
+sqlite3_stmt* json_stmt(sqlite3 *db, enum JsonStmt type) {
+  char sql[512];
+
+  if (stmts_[type] != NULL)
+    return stmts_[type];
+
+  switch (type) {
+  case JSON_INSERT:
+    snprintf(sql, sizeof(sql), "REPLACE INTO docs (id, doc) VALUES (?, %s)",
+             jsonb_ ? "jsonb(?)" : "?");
+    break;
+  case JSON_LOOKUP:
+    if (index_ == JSON_INDEX_EXPRESSION)
+      snprintf(sql, sizeof(sql), "SELECT %s FROM docs WHERE "
+               "json_extract(doc, '%s') = ?", jsonb_ ? "json(doc)" : "doc",
+               ref_path_);
+    else
+      snprintf(sql, sizeof(sql), "SELECT %s FROM docs WHERE ref = ?",
+               jsonb_ ? "json(doc)" : "doc");
+    break;
+  case JSON_UPDATE:
+    snprintf(sql, sizeof(sql), "UPDATE docs SET doc = %s(doc, '%s', ?) "
+             "WHERE id = ?", jsonb_ ? "jsonb_set" : "json_set",
+             kJsonUpdatePath);
+    break;
+  default:
+    return NULL;
+  }
+  if (sqlite3_prepare_v2(db, sql, -1, &stmts_[type], NULL) != SQLITE_OK) {
+    fprintf(stderr, "prepare error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+
+  return stmts_[type];
+}
+
+void json_finalize() {
+  int i;
+
+  for (i = 0; i < kNumJsonStmts; i++) {
+    sqlite3_finalize(stmts_[i]);
+    stmts_[i] = NULL;
+  }
+}
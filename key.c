@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * Table layout and key encoding. Key number k is stored as
+ *
+ *   ascii   -- 16 bytes, zero-padded decimal ("%016ld")
+ *   binary  -- 8 bytes, big-endian, so blob order matches numeric order
+ *
+ * in a blob column of a rowid table with a separate primary key index
+ * (rowid_blob) or of a WITHOUT ROWID table (without_rowid). With
+ * integer_pk the key is the rowid itself and the encoding is unused.
+ */
+static int table_layout_ = LAYOUT_ROWID_BLOB;
+static bool binary_keys_;
+
+/* With key_trace on, the last key bound and how many keys were bound. */
+static bool trace_;
+static long last_key_;
+static long binds_;
+
+static const char *layout_names[] = { "rowid_blob", "integer_pk",
+                                      "without_rowid" };
+
+void key_init() {
+  size_t i;
+
+  table_layout_ = -1;
+  for (i = 0; i < sizeof(layout_names) / sizeof(layout_names[0]); i++)
+    if (!strcasecmp(FLAGS_table_layout, layout_names[i]))
+      table_layout_ = i;
+  if (table_layout_ < 0) {
+    fprintf(stderr, "unknown table layout '%s'\n", FLAGS_table_layout);
+    exit(1);
+  }
+
+  if (!strcasecmp(FLAGS_key_encoding, "binary")) {
+    binary_keys_ = true;
+  } else if (!strcasecmp(FLAGS_key_encoding, "ascii")) {
+    binary_keys_ = false;
+  } else {
+    fprintf(stderr, "unknown key encoding '%s'\n", FLAGS_key_encoding);
+    exit(1);
+  }
+}
+
+int key_layout() {
+  return table_layout_;
+}
+
+const char* key_layout_name() {
+  return layout_names[table_layout_];
+}
+
+/* Bytes per key as stored; integer keys are varints of up to 8 bytes. */
+int key_size() {
+  if (table_layout_ == LAYOUT_INTEGER_PK || binary_keys_)
+    return 8;
+  return 16;
+}
+
+const char* key_schema() {
+  switch (table_layout_) {
+  case LAYOUT_INTEGER_PK:
+    return "CREATE TABLE test (key INTEGER PRIMARY KEY, value blob)";
+  case LAYOUT_WITHOUT_ROWID:
+    return "CREATE TABLE test (key blob PRIMARY KEY, value blob) WITHOUT ROWID";
+  default:
+    return "CREATE TABLE test (key blob, value blob, PRIMARY KEY (key))";
+  }
+}
+
+/* Bind key k to parameter idx; buf must hold 17 bytes and outlive the step. */
+void bind_key(sqlite3_stmt *stmt, int idx, char *buf, long k) {
+  int status;
+  int i;
+
+  if (trace_) {
+    __atomic_store_n(&last_key_, k, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&binds_, 1, __ATOMIC_RELAXED);
+  }
+  if (table_layout_ == LAYOUT_INTEGER_PK) {
+    status = sqlite3_bind_int64(stmt, idx, k);
+  } else if (binary_keys_) {
+    for (i = 7; i >= 0; i--, k >>= 8)
+      buf[i] = (char)(k & 0xff);
+    status = sqlite3_bind_blob(stmt, idx, buf, 8, SQLITE_STATIC);
+  } else {
+    snprintf(buf, 17, "%016ld", k);
+    status = sqlite3_bind_blob(stmt, idx, buf, 16, SQLITE_STATIC);
+  }
+
+  if (status != SQLITE_OK) {
+    fprintf(stderr, "SQL error: status = %d\n", status);
+    exit(1);
+  }
+}
+
+void key_trace(bool on) {
+  trace_ = on;
+}
+
+long key_last() {
+  return __atomic_load_n(&last_key_, __ATOMIC_RELAXED);
+}
+
+long key_binds() {
+  return __atomic_load_n(&binds_, __ATOMIC_RELAXED);
+}
@@ -8,20 +8,51 @@
 char* FLAGS_benchmarks;
 
 // Number of key/values to place in the database.
-int FLAGS_num_keys;
+long FLAGS_num_keys;
 
 // Number of operations to do for the benchmark.
 long FLAGS_num_ops;
 
 // Number of read operations to do.  If negative, do FLAGS_num reads.
-int FLAGS_reads;
+long FLAGS_reads;
 
 // Size of each value
 int FLAGS_value_size;
 
+// Distribution of value sizes, or NULL for FLAGS_value_size.
+char* FLAGS_value_size_dist;
+
 // Print histogram of operation timings
 bool FLAGS_histogram;
 
+// Number of unmeasured operations to run before each measurement.
+long FLAGS_warmup_ops;
+
+// Reopen the database with its files evicted from the OS page cache
+// before each read benchmark.
+bool FLAGS_cold;
+
+// Run each benchmark for this many seconds instead of a fixed op count.
+double FLAGS_duration;
+
+// If positive, warm up until interval throughput cv drops below this.
+double FLAGS_steady_cv;
+
+// Number of intervals the steady-state cv is computed over.
+int FLAGS_steady_window;
+
+// Length of a steady-state interval in milliseconds.
+int FLAGS_steady_interval_ms;
+
+// Number of times to run each benchmark from the same database state.
+int FLAGS_repetitions;
+
+// If positive, repeat until the throughput cv drops below this fraction.
+double FLAGS_cv_threshold;
+
+// Upper bound on repetitions when FLAGS_cv_threshold is set.
+int FLAGS_max_repetitions;
+
 // Print raw data
 bool FLAGS_raw;
 
@@ -50,9 +81,179 @@ bool FLAGS_transaction;
 // If true, we enable Write-Ahead Logging
 bool FLAGS_WAL_enabled;
 
+// Journal mode; overrides FLAGS_WAL_enabled if set.
+char* FLAGS_journal_mode;
+
+// Synchronous mode; if NULL it is chosen from the benchmark name.
+char* FLAGS_synchronous;
+
+// Parameter sweep specification.
+char* FLAGS_sweep;
+
+// Write results as JSON to this path.
+char* FLAGS_json;
+
+// Compare two JSON result files and exit.
+char* FLAGS_compare;
+
+// Percentage change that --compare flags as a regression.
+double FLAGS_regression_threshold;
+
 // Configure how many pages to use for WAL
 int FLAGS_checkpoint_granularity;
 
+// auto_vacuum mode for new databases.
+char* FLAGS_auto_vacuum;
+
+// Run PRAGMA incremental_vacuum every this many operations.
+int FLAGS_incremental_vacuum_interval;
+
+// Pages to free per incremental_vacuum (0 = all).
+int FLAGS_incremental_vacuum_pages;
+
+// Print throughput, database size and freelist every this many ops.
+int FLAGS_stats_interval;
+
+// Random overwrites and deletes applied by the aging benchmark.
+long FLAGS_aging_ops;
+
+// Percentage of aging operations that delete instead of overwrite.
+int FLAGS_aging_delete_percent;
+
+// Rows read by each range scan.
+int FLAGS_scan_length;
+
+// Bytes read or written per operation by the blob and row range benchmarks.
+int FLAGS_blob_io_size;
+
+// Run read benchmarks with mmap off, over half and over all of the file.
+bool FLAGS_mmap_compare;
+
+// madvise hint for the mmap region.
+char* FLAGS_madvise;
+
+// Print VFS calls and page faults per operation after each benchmark.
+bool FLAGS_io_stats;
+
+// SQLite locking mode: EXCLUSIVE or NORMAL.
+char* FLAGS_locking_mode;
+
+// Reader threads for readwhilewriting.
+int FLAGS_threads;
+
+// Writer transactions per second for readwhilewriting (0 = unthrottled).
+int FLAGS_write_rate;
+
+// Percentage of readwhilewriting reads that are range scans.
+int FLAGS_reader_scan_percent;
+
+// Most requests the group committer applies in one transaction.
+int FLAGS_group_commit_max;
+
+// Microseconds the oldest pending request waits for others to join it.
+int FLAGS_group_commit_wait_us;
+
+// Table layout: rowid_blob, integer_pk or without_rowid.
+char* FLAGS_table_layout;
+
+// Blob key encoding: ascii or binary.
+char* FLAGS_key_encoding;
+
+// CPUs to pin threads to.
+char* FLAGS_cpu_list;
+
+// NUMA memory policy.
+char* FLAGS_numa_policy;
+
+// Rerun threaded benchmarks at 1, 2, 4, ... up to FLAGS_threads threads.
+bool FLAGS_scaling;
+
+// Time key generation, bind, step, reset, BEGIN and COMMIT separately.
+bool FLAGS_phase_stats;
+
+// Sample memory use every this many milliseconds (0 = off).
+int FLAGS_mem_sample_ms;
+
+// Run the PGO training mix instead of FLAGS_benchmarks.
+bool FLAGS_pgo_training;
+
+// Size num_keys so the raw dataset is this many times physical memory.
+double FLAGS_dataset_ram_ratio;
+
+// Random generator for keys and workloads: park_miller or xoshiro.
+char* FLAGS_rng;
+
+// Random-order writes visit each key once, via a random permutation.
+bool FLAGS_unique_keys;
+
+// Serve live statistics on this Unix-domain socket (NULL = off).
+char* FLAGS_export_socket;
+
+// Log operations that take at least this many microseconds (0 = off).
+int FLAGS_slow_op_us;
+
+// File the slow operations are logged to, one JSON object per line.
+char* FLAGS_slow_op_log;
+
+// Record WAL growth and checkpoints per benchmark to this CSV (NULL = off).
+char* FLAGS_wal_timeline;
+
+// How transactions begin: deferred, immediate or exclusive.
+char* FLAGS_txn_mode;
+
+// Longest a busy handler waits for one lock, in ms (0 = no handler).
+int FLAGS_busy_timeout_ms;
+
+// Times a transaction that got SQLITE_BUSY is retried before aborting.
+int FLAGS_busy_retries;
+
+// Rows in the counters table incrandom increments.
+long FLAGS_counter_rows;
+
+// Fields per object of a generated JSON document.
+int FLAGS_json_fields;
+
+// Levels of nested objects in a generated JSON document.
+int FLAGS_json_depth;
+
+// How documents are stored: text or jsonb.
+char* FLAGS_json_storage;
+
+// How lookups by path are indexed: expression, virtual or stored.
+char* FLAGS_json_index;
+
+// Keys in the range each analytic query covers.
+long FLAGS_query_rows;
+
+// Rows returned by the top-N query.
+int FLAGS_query_limit;
+
+// PRAGMA temp_store: DEFAULT, FILE or MEMORY (NULL = leave as built).
+char* FLAGS_temp_store;
+
+/*
+ * The training mix for profile-guided builds: the single-threaded write,
+ * read, update, delete and scan paths plus large values and blob I/O.
+ * Sync benchmarks are left out because they mostly wait on the disk.
+ */
+static char pgo_training_benchmarks[] =
+    "fillseq,"
+    "fillrandom,"
+    "fillrandbatch,"
+    "updaterandbatch,"
+    "readseq,"
+    "readrandom,"
+    "rwrandom,"
+    "updaterandom,"
+    "scanrandom,"
+    "churnrandom,"
+    "deleterandom,"
+    "fillrand100K,"
+    "readrand100K,"
+    "blobread,"
+    "rowread,"
+    ;
+
 // Configure the write percentage for mixed read/write benchmarks.
 int FLAGS_write_percent;
 
@@ -105,7 +306,17 @@ void init() {
     ;
   FLAGS_reads = -1;
   FLAGS_value_size = 100;
+  FLAGS_value_size_dist = NULL;
   FLAGS_histogram = false;
+  FLAGS_warmup_ops = 0;
+  FLAGS_cold = false;
+  FLAGS_duration = 0;
+  FLAGS_steady_cv = 0;
+  FLAGS_steady_window = 5;
+  FLAGS_steady_interval_ms = 1000;
+  FLAGS_repetitions = 1;
+  FLAGS_cv_threshold = 0;
+  FLAGS_max_repetitions = 20;
   FLAGS_raw = false,
   FLAGS_compression_ratio = 0.5;
   FLAGS_page_size = 4096;
@@ -114,7 +325,56 @@ void init() {
   FLAGS_transaction = true;
   FLAGS_benchmark_single_op = false,
   FLAGS_WAL_enabled = true;
+  FLAGS_journal_mode = NULL;
+  FLAGS_synchronous = NULL;
+  FLAGS_sweep = NULL;
+  FLAGS_json = NULL;
+  FLAGS_compare = NULL;
+  FLAGS_regression_threshold = 5.0;
   FLAGS_checkpoint_granularity = 1024;
+  FLAGS_auto_vacuum = NULL;
+  FLAGS_incremental_vacuum_interval = 0;
+  FLAGS_incremental_vacuum_pages = 0;
+  FLAGS_stats_interval = 0;
+  FLAGS_aging_ops = 0;
+  FLAGS_aging_delete_percent = 20;
+  FLAGS_scan_length = 100;
+  FLAGS_blob_io_size = 4096;
+  FLAGS_mmap_compare = false;
+  FLAGS_madvise = NULL;
+  FLAGS_io_stats = false;
+  FLAGS_locking_mode = "EXCLUSIVE";
+  FLAGS_threads = 1;
+  FLAGS_write_rate = 0;
+  FLAGS_reader_scan_percent = 10;
+  FLAGS_group_commit_max = 64;
+  FLAGS_group_commit_wait_us = 1000;
+  FLAGS_table_layout = "rowid_blob";
+  FLAGS_key_encoding = "ascii";
+  FLAGS_cpu_list = NULL;
+  FLAGS_numa_policy = NULL;
+  FLAGS_scaling = false;
+  FLAGS_phase_stats = false;
+  FLAGS_mem_sample_ms = 0;
+  FLAGS_pgo_training = false;
+  FLAGS_dataset_ram_ratio = 0;
+  FLAGS_rng = "park_miller";
+  FLAGS_unique_keys = false;
+  FLAGS_export_socket = NULL;
+  FLAGS_slow_op_us = 0;
+  FLAGS_slow_op_log = "/tmp/slow_ops.jsonl";
+  FLAGS_wal_timeline = NULL;
+  FLAGS_txn_mode = "deferred";
+  FLAGS_busy_timeout_ms = 5000;
+  FLAGS_busy_retries = 10;
+  FLAGS_counter_rows = 16;
+  FLAGS_json_fields = 8;
+  FLAGS_json_depth = 2;
+  FLAGS_json_storage = "text";
+  FLAGS_json_index = "expression";
+  FLAGS_query_rows = 10000;
+  FLAGS_query_limit = 10;
+  FLAGS_temp_store = NULL;
   FLAGS_write_percent = 50;
   FLAGS_mmap_size_mb = 4;
   FLAGS_oid = 0;
@@ -132,22 +392,87 @@ void print_usage(const char* argv0) {
   fprintf(stderr, "  --benchmarks=[BENCH]\t\tspecify benchmark\n");
   fprintf(stderr, "  --histogram={0,1}\t\trecord histogram\n");
   fprintf(stderr, "  --raw={0,1}\t\t\toutput raw data\n");
+  fprintf(stderr, "  --warmup_ops=INT\t\tunmeasured operations before each run\n");
+  fprintf(stderr, "  --cold={0,1}\t\t\tread benchmarks start with cold SQLite and OS caches\n");
+  fprintf(stderr, "  --duration=SECONDS		run each benchmark for SECONDS instead of num_ops\n");
+  fprintf(stderr, "  --steady_cv=DOUBLE		warm up until interval throughput cv is below this\n");
+  fprintf(stderr, "  --steady_window=INT		intervals the steady-state cv covers (2-64)\n");
+  fprintf(stderr, "  --steady_interval_ms=INT	length of a steady-state interval\n");
+  fprintf(stderr, "  --repetitions=INT\t\truns of each benchmark from the same state\n");
+  fprintf(stderr, "  --cv_threshold=DOUBLE\t\trepeat until throughput cv is below this\n");
+  fprintf(stderr, "  --max_repetitions=INT\t\tupper bound on runs with --cv_threshold\n");
   fprintf(stderr, "  --compression_ratio=DOUBLE\tcompression ratio\n");
   fprintf(stderr, "  --use_existing_db={0,1}\tuse existing database\n");
   fprintf(stderr, "  --num_keys=INT\t\t\tnumber of keys\n");
   fprintf(stderr, "  --num_ops=INT\t\t\tnumber of operations\n");
   fprintf(stderr, "  --reads=INT\t\t\tnumber of reads\n");
   fprintf(stderr, "  --value_size=INT\t\tvalue size\n");
+  fprintf(stderr, "  --value_size_dist=DIST\tvalue size distribution: fixed,\n"
+                  "\t\t\t\tuniform:MIN:MAX, normal:MEAN:STDDEV,\n"
+                  "\t\t\t\tpareto:MIN:ALPHA[:MAX] or file:PATH\n");
   fprintf(stderr, "  --no_transaction\t\tdisable transaction\n");
   fprintf(stderr, "  --benchmark_single_op\t\tstatistics for individual operations, not transactions\n");
   fprintf(stderr, "  --page_size=INT\t\tpage size\n");
   fprintf(stderr, "  --num_pages=INT\t\tnumber of pages\n");
   fprintf(stderr, "  --WAL_enabled={0,1}\t\tenable WAL\n");
   fprintf(stderr, "  --WAL_size=INT\t\tWAL size in pages\n");
+  fprintf(stderr, "  --journal_mode=MODE\t\tjournal mode, overrides --WAL_enabled\n");
+  fprintf(stderr, "  --synchronous=MODE\t\tsynchronous mode for all benchmarks\n");
+  fprintf(stderr, "  --sweep=SPEC\t\t\trun the benchmarks over a parameter grid, e.g.\n"
+                  "\t\t\t\t\"page_size=1024,4096;num_pages=1000:16000:x2\"\n"
+                  "\t\t\t\tsweepable: page_size, num_pages, mmap_size_mb,\n"
+                  "\t\t\t\tbatch_size, checkpoint_granularity,\n"
+                  "\t\t\t\tjournal_mode, synchronous\n");
   fprintf(stderr, "  --write_percent=INT\t\twrite %% in rw benchmarks\n");
+  fprintf(stderr, "  --auto_vacuum=MODE\t\tNONE, FULL or INCREMENTAL\n");
+  fprintf(stderr, "  --incremental_vacuum_interval=INT\tops between incremental_vacuum runs\n");
+  fprintf(stderr, "  --incremental_vacuum_pages=INT\tpages freed per run (0 = all)\n");
+  fprintf(stderr, "  --stats_interval=INT\t\tprint throughput, size and freelist every INT ops\n");
+  fprintf(stderr, "  --aging_ops=INT\t\toverwrites and deletes applied by aging (default: N)\n");
+  fprintf(stderr, "  --aging_delete_percent=INT\tpercentage of aging ops that delete\n");
+  fprintf(stderr, "  --scan_length=INT\t\trows read per range scan\n");
+  fprintf(stderr, "  --blob_io_size=INT\t\tbytes per blob/row range read or write\n");
+  fprintf(stderr, "  --mmap_compare={0,1}\t\trun reads with mmap off, over half and all of the file\n");
+  fprintf(stderr, "  --madvise=HINT\t\tNORMAL, RANDOM, SEQUENTIAL or WILLNEED for the mmap region\n");
+  fprintf(stderr, "  --io_stats={0,1}\t\tprint syscalls and page faults per op\n");
+  fprintf(stderr, "  --locking_mode=MODE\t\tEXCLUSIVE or NORMAL (WAL shared memory)\n");
+  fprintf(stderr, "  --threads=INT\t\t\treader threads for readwhilewriting\n");
+  fprintf(stderr, "  --write_rate=INT\t\twriter transactions/sec for readwhilewriting (0 = max)\n");
+  fprintf(stderr, "  --reader_scan_percent=INT\tpercentage of readwhilewriting reads that scan\n");
+  fprintf(stderr, "  --group_commit_max=INT\tmost requests per group commit\n");
+  fprintf(stderr, "  --group_commit_wait_us=INT\tmicros a request waits for others to join\n");
+  fprintf(stderr, "  --table_layout=LAYOUT\t\trowid_blob, integer_pk or without_rowid\n");
+  fprintf(stderr, "  --key_encoding=ENC\t\tascii (16-byte decimal) or binary (8-byte big-endian)\n");
+  fprintf(stderr, "  --cpu_list=LIST\t\tpin thread t to the t-th CPU of LIST, e.g. 0,2,4-7\n");
+  fprintf(stderr, "  --numa_policy=POLICY\t\tlocal, interleave[:NODES] or bind:NODES\n");
+  fprintf(stderr, "  --scaling={0,1}\t\trerun threaded reads at 1, 2, 4, ... --threads\n");
+  fprintf(stderr, "  --phase_stats={0,1}\t\tlatency of keygen, bind, step, reset, begin and commit\n");
+  fprintf(stderr, "  --mem_sample_ms=INT\t\tsample RSS and SQLite memory every INT ms (0 = off)\n");
+  fprintf(stderr, "  --pgo_training={0,1}\t\trun the profile-guided build training mix\n");
+  fprintf(stderr, "  --dataset_ram_ratio=FLOAT\tsize num_keys to FLOAT times physical memory\n");
+  fprintf(stderr, "  --rng=NAME\t\t\trandom generator: park_miller or xoshiro\n");
+  fprintf(stderr, "  --unique_keys={0,1}\t\trandom-order writes visit each key exactly once\n");
+  fprintf(stderr, "  --export_socket=PATH\t\tserve live Prometheus-format stats on a Unix socket\n");
+  fprintf(stderr, "  --slow_op_us=INT\t\tlog ops taking at least INT micros with context\n");
+  fprintf(stderr, "  --slow_op_log=PATH\t\tJSON lines file for --slow_op_us\n");
+  fprintf(stderr, "  --wal_timeline=PATH\t\tCSV of WAL size and checkpoints; prints a summary\n");
+  fprintf(stderr, "  --txn_mode=MODE\t\tBEGIN deferred, immediate or exclusive\n");
+  fprintf(stderr, "  --busy_timeout_ms=INT\t\tbusy handler wait per lock for rmw clients (0 = none)\n");
+  fprintf(stderr, "  --busy_retries=INT\t\tretries of a busy transaction before it aborts\n");
+  fprintf(stderr, "  --counter_rows=INT\t\trows in the counters table for incrandom\n");
+  fprintf(stderr, "  --json_fields=INT\t\tfields per object of a JSON document\n");
+  fprintf(stderr, "  --json_depth=INT\t\tlevels of nested objects in a JSON document\n");
+  fprintf(stderr, "  --json_storage=STORAGE\ttext or jsonb\n");
+  fprintf(stderr, "  --json_index=INDEX\t\texpression, virtual or stored generated column\n");
+  fprintf(stderr, "  --query_rows=INT\t\tkeys in the range each analytic query covers\n");
+  fprintf(stderr, "  --query_limit=INT\t\trows returned by querytopn\n");
+  fprintf(stderr, "  --temp_store=MODE\t\tPRAGMA temp_store: DEFAULT, FILE or MEMORY\n");
   fprintf(stderr, "  --mmap_size_mb=INT\t\tMBs of memory region size for mmap IO\n");
   fprintf(stderr, "  --db=PATH\t\t\tpath to location databases are created\n");
   fprintf(stderr, "  --extension=NAME\t\tname of extension to be loaded\n");
+  fprintf(stderr, "  --json=PATH\t\t\twrite results as JSON\n");
+  fprintf(stderr, "  --compare=BASE,CUR\t\tcompare two JSON result files, exit 1 on regression\n");
+  fprintf(stderr, "  --regression_threshold=PCT\tthroughput drop or p99 growth that regresses\n");
   fprintf(stderr, "  --help\t\t\tshow this help\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "[BENCH]\n");
@@ -163,6 +488,38 @@ void print_usage(const char* argv0) {
   fprintf(stderr, "  readseq\tread N times sequentially\n");
   fprintf(stderr, "  readrandom\tread N times in random order\n");
   fprintf(stderr, "  readrand100K\tread N/1000 100K values in sequential order in async mode\n");
+  fprintf(stderr, "  updateseq\tupdate N values in place in sequential key order\n");
+  fprintf(stderr, "  updaterandom\tupdate N values in place in random key order\n");
+  fprintf(stderr, "  deleteseq\tdelete N values in sequential key order\n");
+  fprintf(stderr, "  deleterandom\tdelete N values in random key order\n");
+  fprintf(stderr, "  churnseq\tdelete the oldest key and insert a new one, N times\n");
+  fprintf(stderr, "  churnrandom\tdelete a random key and insert a new one, N times\n");
+  fprintf(stderr, "  scanseq\trange scans of scan_length rows from sequential keys\n");
+  fprintf(stderr, "  scanrandom\trange scans of scan_length rows from random keys\n");
+  fprintf(stderr, "  aging\t\tscan fresh, aged and vacuumed tables and time VACUUM\n");
+  fprintf(stderr, "  blobread\tread blob_io_size bytes of a value with sqlite3_blob_read\n");
+  fprintf(stderr, "  blobwrite\toverwrite blob_io_size bytes of a value in place\n");
+  fprintf(stderr, "  rowread\tread a whole value with SELECT and copy blob_io_size bytes\n");
+  fprintf(stderr, "  rowwrite\tpatch blob_io_size bytes of a value with SELECT + UPDATE\n");
+  fprintf(stderr, "  readwhilewriting\treader threads under a rate-limited writer\n");
+  fprintf(stderr, "  groupcommit\tclient threads sharing transactions through one committer\n");
+  fprintf(stderr, "  groupcommitsync\tgroupcommit with synchronous=FULL\n");
+  fprintf(stderr, "  load\t\tbuild the table of num_keys rows in key order, with progress\n");
+  fprintf(stderr, "  readrandommiss\treadrandom reporting page cache, mmap and fault misses\n");
+  fprintf(stderr, "  rmwrandom\tclient threads that read a value and write it back in one txn\n");
+  fprintf(stderr, "  incrandom\tclient threads that increment counters with read-then-write\n");
+  fprintf(stderr, "  jsonfillseq\twrite JSON documents in key order\n");
+  fprintf(stderr, "  jsonfillrandom\twrite JSON documents in random key order\n");
+  fprintf(stderr, "  jsonreadrandom\tlook up JSON documents by a nested path through its index\n");
+  fprintf(stderr, "  jsonupdaterandom\tset one field of random JSON documents with json_set\n");
+  fprintf(stderr, "  queryagg\tCOUNT/SUM/AVG over a range of query_rows keys\n");
+  fprintf(stderr, "  querygroup\tGROUP BY a column derived from the value over a range\n");
+  fprintf(stderr, "  querytopn\tORDER BY a derived column with LIMIT query_limit\n");
+  fprintf(stderr, "  querysort\tORDER BY a derived column returning the whole range\n");
+  fprintf(stderr, "  queryjoin\tjoin a range against the groups of another range\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  A size suffix such as 4K or 100K runs N/1000 operations on values of\n");
+  fprintf(stderr, "  that many KB, e.g. fillseq16K, and reports overflow page usage.\n");
 
 }
 
@@ -185,15 +542,40 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--raw=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_raw = n;
+    } else if (sscanf(argv[i], "--warmup_ops=%ld%c", &l, &junk) == 1) {
+      FLAGS_warmup_ops = l;
+    } else if (sscanf(argv[i], "--cold=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cold = n;
+    } else if (sscanf(argv[i], "--duration=%lf%c", &d, &junk) == 1 && d >= 0) {
+      FLAGS_duration = d;
+    } else if (sscanf(argv[i], "--steady_cv=%lf%c", &d, &junk) == 1 && d >= 0) {
+      FLAGS_steady_cv = d;
+    } else if (sscanf(argv[i], "--steady_window=%d%c", &n, &junk) == 1 &&
+               n >= 2 && n <= kMaxSteadyWindow) {
+      FLAGS_steady_window = n;
+    } else if (sscanf(argv[i], "--steady_interval_ms=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_steady_interval_ms = n;
+    } else if (sscanf(argv[i], "--repetitions=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_repetitions = n;
+    } else if (sscanf(argv[i], "--cv_threshold=%lf%c", &d, &junk) == 1) {
+      FLAGS_cv_threshold = d;
+    } else if (sscanf(argv[i], "--max_repetitions=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_repetitions = n;
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
       FLAGS_compression_ratio = d;
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
-    } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
-      FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--reads=%ld%c", &l, &junk) == 1) {
+      FLAGS_reads = l;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
+    } else if (starts_with(argv[i], "--value_size_dist=")) {
+      FLAGS_value_size_dist = argv[i] + strlen("--value_size_dist=");
     } else if (!strcmp(argv[i], "--no_transaction")) {
       FLAGS_transaction = false;
     } else if (!strcmp(argv[i], "--benchmark_single_op")) {
@@ -204,13 +586,129 @@ int main(int argc, char** argv) {
       FLAGS_num_pages = n;
     } else if (sscanf(argv[i], "--num_ops=%ld%c", &l, &junk) == 1) {
       FLAGS_num_ops = l;
-    } else if (sscanf(argv[i], "--num_keys=%d%c", &n, &junk) == 1) {
-      FLAGS_num_keys = n;
+    } else if (sscanf(argv[i], "--num_keys=%ld%c", &l, &junk) == 1) {
+      FLAGS_num_keys = l;
     } else if (sscanf(argv[i], "--WAL_enabled=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_WAL_enabled = n;
+    } else if (starts_with(argv[i], "--journal_mode=")) {
+      FLAGS_journal_mode = argv[i] + strlen("--journal_mode=");
+    } else if (starts_with(argv[i], "--synchronous=")) {
+      FLAGS_synchronous = argv[i] + strlen("--synchronous=");
+    } else if (starts_with(argv[i], "--sweep=")) {
+      /* Repeated --sweep flags add dimensions. */
+      char* spec = argv[i] + strlen("--sweep=");
+      if (FLAGS_sweep != NULL) {
+        char* joined = malloc(strlen(FLAGS_sweep) + strlen(spec) + 2);
+        sprintf(joined, "%s;%s", FLAGS_sweep, spec);
+        spec = joined;
+      }
+      FLAGS_sweep = spec;
     } else if (sscanf(argv[i], "--checkpoint_granularity=%d%c", &n, &junk) == 1) {
       FLAGS_checkpoint_granularity = n;
+    } else if (starts_with(argv[i], "--auto_vacuum=")) {
+      FLAGS_auto_vacuum = argv[i] + strlen("--auto_vacuum=");
+    } else if (sscanf(argv[i], "--incremental_vacuum_interval=%d%c", &n, &junk) == 1) {
+      FLAGS_incremental_vacuum_interval = n;
+    } else if (sscanf(argv[i], "--incremental_vacuum_pages=%d%c", &n, &junk) == 1) {
+      FLAGS_incremental_vacuum_pages = n;
+    } else if (sscanf(argv[i], "--stats_interval=%d%c", &n, &junk) == 1) {
+      FLAGS_stats_interval = n;
+    } else if (sscanf(argv[i], "--aging_ops=%ld%c", &l, &junk) == 1) {
+      FLAGS_aging_ops = l;
+    } else if (sscanf(argv[i], "--aging_delete_percent=%d%c", &n, &junk) == 1) {
+      FLAGS_aging_delete_percent = n;
+    } else if (sscanf(argv[i], "--scan_length=%d%c", &n, &junk) == 1) {
+      FLAGS_scan_length = n;
+    } else if (sscanf(argv[i], "--blob_io_size=%d%c", &n, &junk) == 1) {
+      FLAGS_blob_io_size = n;
+    } else if (sscanf(argv[i], "--mmap_compare=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_mmap_compare = n;
+    } else if (starts_with(argv[i], "--madvise=")) {
+      FLAGS_madvise = argv[i] + strlen("--madvise=");
+    } else if (sscanf(argv[i], "--io_stats=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_io_stats = n;
+    } else if (starts_with(argv[i], "--locking_mode=")) {
+      FLAGS_locking_mode = argv[i] + strlen("--locking_mode=");
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_write_rate = n;
+    } else if (sscanf(argv[i], "--reader_scan_percent=%d%c", &n, &junk) == 1) {
+      FLAGS_reader_scan_percent = n;
+    } else if (sscanf(argv[i], "--group_commit_max=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_group_commit_max = n;
+    } else if (sscanf(argv[i], "--group_commit_wait_us=%d%c", &n, &junk) == 1) {
+      FLAGS_group_commit_wait_us = n;
+    } else if (starts_with(argv[i], "--table_layout=")) {
+      FLAGS_table_layout = argv[i] + strlen("--table_layout=");
+    } else if (starts_with(argv[i], "--key_encoding=")) {
+      FLAGS_key_encoding = argv[i] + strlen("--key_encoding=");
+    } else if (starts_with(argv[i], "--cpu_list=")) {
+      FLAGS_cpu_list = argv[i] + strlen("--cpu_list=");
+    } else if (starts_with(argv[i], "--numa_policy=")) {
+      FLAGS_numa_policy = argv[i] + strlen("--numa_policy=");
+    } else if (sscanf(argv[i], "--scaling=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_scaling = n;
+    } else if (sscanf(argv[i], "--phase_stats=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_phase_stats = n;
+    } else if (sscanf(argv[i], "--mem_sample_ms=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_mem_sample_ms = n;
+    } else if (sscanf(argv[i], "--pgo_training=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pgo_training = n;
+    } else if (sscanf(argv[i], "--dataset_ram_ratio=%lf%c", &d, &junk) == 1 &&
+               d >= 0) {
+      FLAGS_dataset_ram_ratio = d;
+    } else if (starts_with(argv[i], "--rng=")) {
+      FLAGS_rng = argv[i] + strlen("--rng=");
+    } else if (sscanf(argv[i], "--unique_keys=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_unique_keys = n;
+    } else if (starts_with(argv[i], "--export_socket=")) {
+      FLAGS_export_socket = argv[i] + strlen("--export_socket=");
+    } else if (sscanf(argv[i], "--slow_op_us=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_slow_op_us = n;
+    } else if (starts_with(argv[i], "--slow_op_log=")) {
+      FLAGS_slow_op_log = argv[i] + strlen("--slow_op_log=");
+    } else if (starts_with(argv[i], "--wal_timeline=")) {
+      FLAGS_wal_timeline = argv[i] + strlen("--wal_timeline=");
+    } else if (starts_with(argv[i], "--txn_mode=")) {
+      FLAGS_txn_mode = argv[i] + strlen("--txn_mode=");
+    } else if (sscanf(argv[i], "--busy_timeout_ms=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_busy_timeout_ms = n;
+    } else if (sscanf(argv[i], "--busy_retries=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_busy_retries = n;
+    } else if (sscanf(argv[i], "--counter_rows=%ld%c", &l, &junk) == 1 &&
+               l > 0) {
+      FLAGS_counter_rows = l;
+    } else if (sscanf(argv[i], "--json_fields=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_json_fields = n;
+    } else if (sscanf(argv[i], "--json_depth=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 32) {
+      FLAGS_json_depth = n;
+    } else if (starts_with(argv[i], "--json_storage=")) {
+      FLAGS_json_storage = argv[i] + strlen("--json_storage=");
+    } else if (starts_with(argv[i], "--json_index=")) {
+      FLAGS_json_index = argv[i] + strlen("--json_index=");
+    } else if (sscanf(argv[i], "--query_rows=%ld%c", &l, &junk) == 1 &&
+               l > 0) {
+      FLAGS_query_rows = l;
+    } else if (sscanf(argv[i], "--query_limit=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_query_limit = n;
+    } else if (starts_with(argv[i], "--temp_store=")) {
+      FLAGS_temp_store = argv[i] + strlen("--temp_store=");
     } else if (sscanf(argv[i], "--write_percent=%d%c", &n, &junk) == 1) {
       FLAGS_write_percent = n;
     } else if (sscanf(argv[i], "--mmap_size_mb=%d%c", &n, &junk) == 1) {
@@ -223,6 +721,12 @@ int main(int argc, char** argv) {
       FLAGS_batch_size = n;
     } else if (strncmp(argv[i], "--extension=", 12) == 0) {
       FLAGS_extension = argv[i] + 12;
+    } else if (starts_with(argv[i], "--json=")) {
+      FLAGS_json = argv[i] + strlen("--json=");
+    } else if (starts_with(argv[i], "--compare=")) {
+      FLAGS_compare = argv[i] + strlen("--compare=");
+    } else if (sscanf(argv[i], "--regression_threshold=%lf%c", &d, &junk) == 1) {
+      FLAGS_regression_threshold = d;
     } else if (!strcmp(argv[i], "--help")) {
       print_usage(argv[0]);
       exit(0);
@@ -232,12 +736,34 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (FLAGS_compare != NULL) {
+    char* current = strchr(FLAGS_compare, ',');
+    if (current == NULL) {
+      fprintf(stderr, "--compare needs BASELINE,CURRENT\n");
+      exit(2);
+    }
+    *current++ = '\0';
+    exit(compare_run(FLAGS_compare, current) > 0 ? 1 : 0);
+  }
+
+  if (FLAGS_pgo_training)
+    FLAGS_benchmarks = pgo_training_benchmarks;
+
   /* Choose a location for the test database if none given with --db=<path>  */
   if (FLAGS_db == NULL)
       FLAGS_db = default_db_path;
 
+  if (FLAGS_json != NULL)
+    report_open(FLAGS_json);
+
   benchmark_init();
-  benchmark_run();
-  benchmark_fini();
+  if (FLAGS_sweep != NULL) {
+    sweep_run();
+  } else {
+    benchmark_run();
+    benchmark_fini();
+  }
+
+  report_close();
 
   return 0;}
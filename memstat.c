@@ -0,0 +1,218 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#endif
+
+/*
+ * Memory footprint sampler. While a benchmark runs, a thread records the
+ * process RSS (split into anonymous and file-backed on Linux), SQLite's
+ * heap and page cache use, and how much of the database file's mmap
+ * region is resident, every FLAGS_mem_sample_ms. The peak is the largest
+ * sample; the steady state is the mean of the second half of the run.
+ * SQLite keeps no memory statistics with SQLITE_DEFAULT_MEMSTATUS=0, so
+ * memstat_init turns them back on when sampling is enabled.
+ */
+typedef struct MemSample {
+  uint64_t rss_;
+  uint64_t anon_;
+  uint64_t file_;
+  uint64_t heap_;
+  uint64_t pcache_;
+  uint64_t mmap_;
+} MemSample;
+
+static pthread_t sampler_;
+static pthread_mutex_t mu_ = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv_ = PTHREAD_COND_INITIALIZER;
+static bool running_;
+static bool stopping_;
+static char db_path_[1024];
+static MemSample *samples_;
+static int num_samples_;
+static int max_samples_;
+
+/* Must run before SQLite is initialized. */
+void memstat_init() {
+  if (FLAGS_mem_sample_ms > 0)
+    sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1);
+}
+
+#if defined(__linux)
+/* Sum the "Rss:" lines of the mappings of path in /proc/self/smaps. */
+static uint64_t mapped_resident(const char *path) {
+  FILE *f = fopen("/proc/self/smaps", "r");
+  char line[1280];
+  unsigned long lo, hi, kb;
+  bool in_file = false;
+  uint64_t total = 0;
+  size_t len;
+
+  if (f == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+      len = strlen(line);
+      if (len > 0 && line[len - 1] == '\n')
+        line[--len] = '\0';
+      in_file = len >= strlen(path) &&
+                !strcmp(line + len - strlen(path), path);
+    } else if (in_file && sscanf(line, "Rss: %lu kB", &kb) == 1) {
+      total += (uint64_t)kb * 1024;
+    }
+  }
+  fclose(f);
+
+  return total;
+}
+#endif
+
+static void take_sample(MemSample *s) {
+  sqlite3_int64 cur, hi;
+
+  memset(s, 0, sizeof(*s));
+#if defined(__linux)
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  char line[256];
+  unsigned long kb;
+
+  if (f != NULL) {
+    while (fgets(line, sizeof(line), f) != NULL) {
+      if (sscanf(line, "Rss: %lu kB", &kb) == 1)
+        s->rss_ = (uint64_t)kb * 1024;
+      else if (sscanf(line, "Anonymous: %lu kB", &kb) == 1)
+        s->anon_ = (uint64_t)kb * 1024;
+    }
+    fclose(f);
+  }
+  s->file_ = s->rss_ > s->anon_ ? s->rss_ - s->anon_ : 0;
+  s->mmap_ = mapped_resident(db_path_);
+#elif defined(__FreeBSD__)
+  struct kinfo_proc kp;
+  size_t len = sizeof(kp);
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+
+  if (sysctl(mib, 4, &kp, &len, NULL, 0) == 0)
+    s->rss_ = (uint64_t)kp.ki_rssize * getpagesize();
+#endif
+
+  s->heap_ = sqlite3_memory_used();
+  if (sqlite3_status64(SQLITE_STATUS_PAGECACHE_OVERFLOW, &cur, &hi, 0) ==
+      SQLITE_OK)
+    s->pcache_ = cur;
+}
+
+static void add_sample(void) {
+  if (num_samples_ == max_samples_) {
+    max_samples_ = max_samples_ ? 2 * max_samples_ : 256;
+    samples_ = realloc(samples_, sizeof(MemSample) * max_samples_);
+  }
+  take_sample(&samples_[num_samples_++]);
+}
+
+static void* sampler_main(void *arg) {
+  struct timespec deadline;
+
+  pthread_mutex_lock(&mu_);
+  while (!stopping_) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += FLAGS_mem_sample_ms / 1000;
+    deadline.tv_nsec += (long)(FLAGS_mem_sample_ms % 1000) * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&cv_, &mu_, &deadline);
+    if (!stopping_)
+      add_sample();
+  }
+  pthread_mutex_unlock(&mu_);
+
+  return NULL;
+}
+
+static void join_sampler(void) {
+  pthread_mutex_lock(&mu_);
+  stopping_ = true;
+  pthread_cond_signal(&cv_);
+  pthread_mutex_unlock(&mu_);
+  pthread_join(sampler_, NULL);
+  running_ = false;
+}
+
+/* Start sampling; db_path is the database whose mapping is tracked. */
+void memstat_start(const char *db_path) {
+  sqlite3_int64 cur, hi;
+
+  if (running_)
+    join_sampler();
+
+  snprintf(db_path_, sizeof(db_path_), "%s", db_path ? db_path : "");
+  sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &cur, &hi, 1);
+  sqlite3_status64(SQLITE_STATUS_PAGECACHE_OVERFLOW, &cur, &hi, 1);
+  num_samples_ = 0;
+  add_sample();
+
+  stopping_ = false;
+  running_ = pthread_create(&sampler_, NULL, sampler_main, NULL) == 0;
+}
+
+#define PEAK(field) if (s->field > stats->field##peak_) stats->field##peak_ = s->field
+
+void memstat_stop(MemStats *stats) {
+  sqlite3_int64 cur, hi;
+  MemSample *s;
+  int i, half;
+
+  memset(stats, 0, sizeof(*stats));
+  if (running_)
+    join_sampler();
+  add_sample();
+
+  half = num_samples_ / 2;
+  for (i = 0; i < num_samples_; i++) {
+    s = &samples_[i];
+    PEAK(rss_);
+    PEAK(anon_);
+    PEAK(file_);
+    PEAK(heap_);
+    PEAK(pcache_);
+    PEAK(mmap_);
+    if (i < half)
+      continue;
+    stats->rss_steady_ += s->rss_ / (num_samples_ - half);
+    stats->anon_steady_ += s->anon_ / (num_samples_ - half);
+    stats->file_steady_ += s->file_ / (num_samples_ - half);
+    stats->heap_steady_ += s->heap_ / (num_samples_ - half);
+    stats->pcache_steady_ += s->pcache_ / (num_samples_ - half);
+    stats->mmap_steady_ += s->mmap_ / (num_samples_ - half);
+  }
+  stats->samples_ = num_samples_;
+
+  /* SQLite's own high-water marks also catch spikes between samples. */
+  if (sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &cur, &hi, 0) == SQLITE_OK &&
+      (uint64_t)hi > stats->heap_peak_)
+    stats->heap_peak_ = hi;
+  if (sqlite3_status64(SQLITE_STATUS_PAGECACHE_OVERFLOW, &cur, &hi, 0) ==
+      SQLITE_OK && (uint64_t)hi > stats->pcache_peak_)
+    stats->pcache_peak_ = hi;
+}
+
+#define MB(x) ((x) / 1048576.0)
+
+void memstat_print(const MemStats *stats) {
+  fprintf(stderr, "  Memory (MB, peak/steady): RSS %.1f/%.1f, anon %.1f/%.1f, "
+          "file %.1f/%.1f, mmap resident %.1f/%.1f\n",
+          MB(stats->rss_peak_), MB(stats->rss_steady_),
+          MB(stats->anon_peak_), MB(stats->anon_steady_),
+          MB(stats->file_peak_), MB(stats->file_steady_),
+          MB(stats->mmap_peak_), MB(stats->mmap_steady_));
+  fprintf(stderr, "  SQLite (MB, peak/steady): heap %.1f/%.1f, "
+          "page cache %.1f/%.1f (%d samples)\n",
+          MB(stats->heap_peak_), MB(stats->heap_steady_),
+          MB(stats->pcache_peak_), MB(stats->pcache_steady_),
+          stats->samples_);
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#include <inttypes.h>
+
+/*
+ * Analytic queries over the test table. Every query covers a range of
+ * FLAGS_query_rows keys, [?1, ?2), at a random start. The join adds a
+ * second range [?3, ?4); top-N takes its limit as ?3. Derived columns
+ * come from the value bytes, so they work with every table layout and
+ * key encoding: substr(value, 1, 1) has up to 95 distinct values.
+ *
+ * Sorts, GROUP BY, DISTINCT and automatic indexes that outgrow the page
+ * cache spill to temporary files, or to memory with temp_store=MEMORY.
+ * The statement counters and the VFS's temporary file counters show
+ * which queries spilled and how much.
+ */
+static const char *query_sql[kNumQueryTypes] = {
+  /* QUERY_AGGREGATE */
+  "SELECT count(*), sum(length(value)), avg(length(value)) FROM test "
+  "WHERE key >= ?1 AND key < ?2",
+  /* QUERY_GROUP */
+  "SELECT substr(value, 1, 1) AS g, count(*), avg(length(value)) FROM test "
+  "WHERE key >= ?1 AND key < ?2 GROUP BY g",
+  /* QUERY_TOPN */
+  "SELECT key, length(value) FROM test WHERE key >= ?1 AND key < ?2 "
+  "ORDER BY substr(value, 2, 8) DESC LIMIT ?3",
+  /* QUERY_SORT */
+  "SELECT key, value FROM test WHERE key >= ?1 AND key < ?2 "
+  "ORDER BY substr(value, 2, 8)",
+  /* QUERY_JOIN: each row of one range against the groups of another. */
+  "WITH g AS MATERIALIZED (SELECT substr(value, 1, 1) AS c, count(*) AS n "
+  "FROM test WHERE key >= ?3 AND key < ?4 GROUP BY c) "
+  "SELECT count(*), sum(g.n) FROM test a JOIN g "
+  "ON g.c = substr(a.value, 1, 1) WHERE a.key >= ?1 AND a.key < ?2",
+};
+
+static const char *query_names[kNumQueryTypes] = {
+  "aggregate", "group", "topn", "sort", "join"
+};
+
+static sqlite3_stmt *stmts_[kNumQueryTypes];
+
+const char* query_name(enum QueryType type) {
+  return query_names[type];
+}
+
+sqlite3_stmt* query_stmt(sqlite3 *db, enum QueryType type) {
+  if (stmts_[type] == NULL &&
+      sqlite3_prepare_v2(db, query_sql[type], -1, &stmts_[type],
+                         NULL) != SQLITE_OK) {
+    fprintf(stderr, "prepare error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+
+  return stmts_[type];
+}
+
+void query_finalize() {
+  int i;
+
+  for (i = 0; i < kNumQueryTypes; i++) {
+    sqlite3_finalize(stmts_[i]);
+    stmts_[i] = NULL;
+  }
+}
+
+/* Start counting: zero the statement counters and sample the VFS. */
+void query_stats_start(QueryStats *stats, sqlite3_stmt *stmt) {
+  memset(stats, 0, sizeof(*stats));
+  sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+  sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+  sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+  iostat_get(&stats->io_);
+}
+
+/* Collect the counters since query_stats_start. */
+void query_stats_stop(QueryStats *stats, sqlite3_stmt *stmt) {
+  IoStats io;
+
+  stats->sorts_ = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+  stats->autoindex_rows_ =
+      sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+  stats->vm_steps_ = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+  iostat_get(&io);
+  stats->temp_opens_ = io.temp_opens_ - stats->io_.temp_opens_;
+  stats->temp_read_bytes_ = io.temp_read_bytes_ - stats->io_.temp_read_bytes_;
+  stats->temp_write_bytes_ =
+      io.temp_write_bytes_ - stats->io_.temp_write_bytes_;
+}
+
+/* One-line summary for the benchmark's result line. */
+void query_stats_format(const QueryStats *stats, double seconds, char *buf,
+                        size_t size) {
+  long n = stats->queries_ > 0 ? stats->queries_ : 1;
+
+  snprintf(buf, size, "(%.0f rows/s processed, %.1f result rows/query; "
+           "%.1f sorts, %.0f autoindex rows, %.0f vm steps per query; "
+           "temp files %" PRIu64 ", written %.1f MB, read %.1f MB)",
+           seconds > 0 ? stats->rows_ / seconds : 0.0,
+           (double)stats->result_rows_ / n, (double)stats->sorts_ / n,
+           (double)stats->autoindex_rows_ / n, (double)stats->vm_steps_ / n,
+           stats->temp_opens_, stats->temp_write_bytes_ / 1048576.0,
+           stats->temp_read_bytes_ / 1048576.0);
+}
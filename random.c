@@ -4,6 +4,8 @@
 
 #include "bench.h"
 
+#define kPi 3.14159265358979323846
+
 static char *random_string(Random*, int);
 static char *compressible_string(Random*, double, size_t);
 
@@ -28,12 +30,14 @@ static char *compressible_string(Random* rnd, double compressed_fraction,
   size_t raw_data_len = strlen(raw_data);
 
   int pos = 0;
-  char* dst = malloc(sizeof(char) * (len + 1));
+  char* dst = malloc(sizeof(char) * (len + raw_data_len + 1));
   dst[0] = '\0';
   while (pos < len) {
-    strcat(dst, raw_data);
+    memcpy(dst + pos, raw_data, raw_data_len + 1);
     pos += raw_data_len;
   }
+  dst[len] = '\0';
+  free(raw_data);
 
   return dst;
 }
@@ -42,6 +46,7 @@ static char *compressible_string(Random* rnd, double compressed_fraction,
  * https://github.com/google/leveldb/blob/master/util/random.h
  */
 void rand_init(Random* rand_, uint32_t s) {
+  rand_->xoshiro_ = false;
   rand_->seed_ = s & 0x7fffffffu;
   /* Avoid bad seeds. */
   if (rand_->seed_ == 0 || rand_->seed_ == 2147483647L) {
@@ -49,10 +54,100 @@ void rand_init(Random* rand_, uint32_t s) {
   }
 }
 
+/*
+ * xoshiro256** (https://prng.di.unimi.it/), seeded through splitmix64.
+ * Faster than Park-Miller and with a 64-bit output. The jump function
+ * advances a generator by 2^128 draws, so streams that share a seed and
+ * differ in their jump count never overlap.
+ */
+static bool use_xoshiro_;
+
+static uint64_t splitmix64(uint64_t* x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro_next(Random* rand_) {
+  uint64_t* s = rand_->s_;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+static void xoshiro_jump(Random* rand_) {
+  static const uint64_t kJump[4] = {
+    0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+  };
+  uint64_t s[4] = { 0, 0, 0, 0 };
+  int i, b, j;
+
+  for (i = 0; i < 4; i++) {
+    for (b = 0; b < 64; b++) {
+      if (kJump[i] & (1ULL << b))
+        for (j = 0; j < 4; j++)
+          s[j] ^= rand_->s_[j];
+      xoshiro_next(rand_);
+    }
+  }
+  memcpy(rand_->s_, s, sizeof(s));
+}
+
+/* Pick the generator rand_seed hands out: "park_miller" or "xoshiro". */
+void rand_select(const char* name) {
+  if (!strcasecmp(name, "xoshiro")) {
+    use_xoshiro_ = true;
+  } else if (!strcasecmp(name, "park_miller")) {
+    use_xoshiro_ = false;
+  } else {
+    fprintf(stderr, "unknown random generator '%s'\n", name);
+    exit(1);
+  }
+}
+
+/*
+ * Seed the stream-th generator of a family. Park-Miller uses seed + stream
+ * as before; xoshiro jumps the seeded state stream times.
+ */
+void rand_seed(Random* rand_, uint32_t seed, int stream) {
+  uint64_t x = seed;
+  int i;
+
+  if (!use_xoshiro_) {
+    rand_init(rand_, seed + stream);
+    return;
+  }
+
+  rand_->xoshiro_ = true;
+  for (i = 0; i < 4; i++)
+    rand_->s_[i] = splitmix64(&x);
+  for (i = 0; i < stream; i++)
+    xoshiro_jump(rand_);
+}
+
 uint32_t rand_next(Random* rand_) {
   static const uint32_t M = 2147483647L;
   static const uint64_t A = 16807;
 
+  /* Same range as Park-Miller: [1, M - 1]. */
+  if (rand_->xoshiro_)
+    return (uint32_t)((xoshiro_next(rand_) >> 33) % (M - 1)) + 1;
+
   uint64_t product = rand_->seed_ * A;
 
   rand_->seed_ = (uint32_t)((product >> 31) + (product & M));
@@ -66,33 +161,258 @@ uint32_t rand_next(Random* rand_) {
 
 uint32_t rand_uniform(Random* rand_, int n) { return rand_next(rand_) % n; }
 
-void rand_gen_init(RandomGenerator* gen_, double compression_ratio) {
+/* A key in [0, n); spaces beyond one draw's range take two draws. */
+long rand_key(Random* rand_, long n) {
+  uint64_t hi, lo;
+
+  /* Lemire's multiply-shift maps 64 random bits onto [0, n). */
+  if (rand_->xoshiro_)
+    return (long)(((unsigned __int128)xoshiro_next(rand_) * (uint64_t)n) >> 64);
+  if (n <= 2147483647L)
+    return rand_next(rand_) % n;
+  hi = rand_next(rand_);
+  lo = rand_next(rand_);
+
+  return (long)(((hi << 31) | lo) % (uint64_t)n);
+}
+
+double rand_double(Random* rand_) {
+  return (rand_next(rand_) - 1) / 2147483646.0;
+}
+
+/*
+ * A bijection over [0, n) that needs no memory: a four-round Feistel
+ * network over the smallest even number of bits covering n, with
+ * cycle-walking to skip results of n or more. Walking the indexes 0, 1,
+ * 2, ... visits every key exactly once in a pseudo-random order.
+ */
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void perm_init(Permutation* perm_, long n, uint64_t seed) {
+  int bits = 2;
+  int i;
+
+  perm_->n_ = n > 0 ? (uint64_t)n : 1;
+  while (bits < 64 && (1ULL << bits) < perm_->n_)
+    bits++;
+  bits += bits & 1;
+  perm_->half_bits_ = bits / 2;
+  perm_->mask_ = (1ULL << perm_->half_bits_) - 1;
+  for (i = 0; i < kFeistelRounds; i++)
+    perm_->keys_[i] = splitmix64(&seed);
+}
+
+long perm_at(const Permutation* perm_, long i) {
+  uint64_t x = (uint64_t)i % perm_->n_;
+  uint64_t l, r, t;
+  int round;
+
+  do {
+    l = x >> perm_->half_bits_;
+    r = x & perm_->mask_;
+    for (round = 0; round < kFeistelRounds; round++) {
+      t = l ^ (mix64(r ^ perm_->keys_[round]) & perm_->mask_);
+      l = r;
+      r = t;
+    }
+    x = (l << perm_->half_bits_) | r;
+  } while (x >= perm_->n_);
+
+  return (long)x;
+}
+
+/* Fill the generator with at least size bytes of compressible data. */
+static void rand_gen_fill(RandomGenerator* gen_, size_t size) {
   Random rnd;
   char* piece;
-  
-  gen_->data_ = malloc(sizeof(char) * 1048576);
+
+  free(gen_->data_);
+  gen_->data_ = malloc(sizeof(char) * (size + 101));
   gen_->data_size_ = 0;
   gen_->pos_ = 0;
-  (gen_->data_)[0] = '\0';
 
   rand_init(&rnd, 301);
-  while (gen_->data_size_ < 1048576) {
-    piece = compressible_string(&rnd, compression_ratio, 100);
-    strcat(gen_->data_, piece);
-    gen_->data_size_ += strlen(piece);
+  while (gen_->data_size_ < size) {
+    piece = compressible_string(&rnd, gen_->compression_ratio_, 100);
+    memcpy(gen_->data_ + gen_->data_size_, piece, 100);
+    gen_->data_size_ += 100;
+    free(piece);
   }
+  gen_->data_[gen_->data_size_] = '\0';
+}
 
-  free(piece);
+void rand_gen_init(RandomGenerator* gen_, double compression_ratio) {
+  gen_->data_ = NULL;
+  gen_->compression_ratio_ = compression_ratio;
+  rand_gen_fill(gen_, 1048576);
 }
 
-char* rand_gen_generate(RandomGenerator* gen_, int len) {
+/*
+ * Returns len bytes of the pool without copying them. The pointer is valid
+ * until the next call with a len at least as large as the pool.
+ */
+const char* rand_gen_generate(RandomGenerator* gen_, int len) {
+  /* Large values need a pool that is bigger than themselves. */
+  if (len >= gen_->data_size_)
+    rand_gen_fill(gen_, 2 * (size_t)len);
   if (gen_->pos_ + len > gen_->data_size_) {
     gen_->pos_ = 0;
     assert(len < gen_->data_size_);
   }
   gen_->pos_ += len;
-  char* substr = malloc(sizeof(char) * (len + 1));
-  strncpy(substr, (gen_->data_) + gen_->pos_ - len, len);
 
-  return substr;
+  return gen_->data_ + gen_->pos_ - len;
+}
+
+/*
+ * Value size distributions. The spec is one of
+ *
+ *   uniform:MIN:MAX
+ *   normal:MEAN:STDDEV
+ *   pareto:MIN:ALPHA[:MAX]
+ *   file:PATH
+ *
+ * where PATH names a histogram with one "SIZE WEIGHT" pair per line.
+ */
+static bool value_dist_load(ValueSizeDist* dist_, const char* path) {
+  FILE* file;
+  char line[256];
+  double weight, total;
+  int size, cap, i;
+
+  file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return false;
+  }
+
+  cap = 64;
+  dist_->sizes_ = malloc(sizeof(int) * cap);
+  dist_->cdf_ = malloc(sizeof(double) * cap);
+  dist_->num_sizes_ = 0;
+  total = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%d %lf", &size, &weight) != 2)
+      continue;
+    if (size < 1 || weight <= 0)
+      continue;
+    if (dist_->num_sizes_ == cap) {
+      cap *= 2;
+      dist_->sizes_ = realloc(dist_->sizes_, sizeof(int) * cap);
+      dist_->cdf_ = realloc(dist_->cdf_, sizeof(double) * cap);
+    }
+    total += weight;
+    dist_->sizes_[dist_->num_sizes_] = size;
+    dist_->cdf_[dist_->num_sizes_] = total;
+    dist_->num_sizes_++;
+  }
+  fclose(file);
+
+  if (dist_->num_sizes_ == 0) {
+    fprintf(stderr, "%s: no histogram entries\n", path);
+    return false;
+  }
+
+  dist_->min_ = dist_->max_ = dist_->sizes_[0];
+  for (i = 0; i < dist_->num_sizes_; i++) {
+    dist_->cdf_[i] /= total;
+    if (dist_->sizes_[i] < dist_->min_)
+      dist_->min_ = dist_->sizes_[i];
+    if (dist_->sizes_[i] > dist_->max_)
+      dist_->max_ = dist_->sizes_[i];
+  }
+
+  return true;
+}
+
+void value_dist_fixed(ValueSizeDist* dist_, int size) {
+  memset(dist_, 0, sizeof(*dist_));
+  dist_->kind_ = DIST_FIXED;
+  dist_->min_ = dist_->max_ = size;
+}
+
+bool value_dist_init(ValueSizeDist* dist_, const char* spec, int size) {
+  double a, b, c;
+  int n;
+
+  value_dist_fixed(dist_, size);
+  if (spec == NULL || !strcmp(spec, "fixed"))
+    return true;
+
+  if (sscanf(spec, "uniform:%lf:%lf", &a, &b) == 2 && a >= 1 && b >= a) {
+    dist_->kind_ = DIST_UNIFORM;
+    dist_->min_ = (int)a;
+    dist_->max_ = (int)b;
+  } else if (sscanf(spec, "normal:%lf:%lf", &a, &b) == 2 && a >= 1 && b >= 0) {
+    dist_->kind_ = DIST_NORMAL;
+    dist_->mean_ = a;
+    dist_->stddev_ = b;
+    dist_->min_ = 1;
+    dist_->max_ = (int)(a + 6 * b);
+  } else if ((n = sscanf(spec, "pareto:%lf:%lf:%lf", &a, &b, &c)) >= 2 &&
+             a >= 1 && b > 0) {
+    dist_->kind_ = DIST_PARETO;
+    dist_->min_ = (int)a;
+    dist_->alpha_ = b;
+    dist_->max_ = (n == 3 && c >= a) ? (int)c : kMaxValueSize;
+  } else if (starts_with(spec, "file:")) {
+    dist_->kind_ = DIST_EMPIRICAL;
+    if (!value_dist_load(dist_, spec + strlen("file:")))
+      return false;
+  } else {
+    return false;
+  }
+
+  if (dist_->max_ > kMaxValueSize)
+    dist_->max_ = kMaxValueSize;
+
+  return true;
+}
+
+int value_dist_next(ValueSizeDist* dist_, Random* rand_) {
+  double u, v, x;
+  int lo, hi, mid;
+
+  switch (dist_->kind_) {
+  case DIST_UNIFORM:
+    x = dist_->min_ + rand_uniform(rand_, dist_->max_ - dist_->min_ + 1);
+    break;
+  case DIST_NORMAL:
+    /* Box-Muller transform */
+    u = rand_double(rand_);
+    v = rand_double(rand_);
+    x = dist_->mean_ + dist_->stddev_ *
+        sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * kPi * v);
+    break;
+  case DIST_PARETO:
+    u = rand_double(rand_);
+    x = dist_->min_ / pow(1.0 - u, 1.0 / dist_->alpha_);
+    break;
+  case DIST_EMPIRICAL:
+    u = rand_double(rand_);
+    lo = 0;
+    hi = dist_->num_sizes_ - 1;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (dist_->cdf_[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    x = dist_->sizes_[lo];
+    break;
+  default:
+    return dist_->min_;
+  }
+
+  if (x < dist_->min_)
+    x = dist_->min_;
+  if (x > dist_->max_)
+    x = dist_->max_;
+
+  return (int)x;
 }
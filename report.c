@@ -0,0 +1,105 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * Results are written as one JSON document:
+ *
+ *   { "sqlite_version": "...", "date": "...",
+ *     "benchmarks": [ { "name": ..., "config": ..., "ops_per_sec": ...,
+ *                       "micros_per_op": ..., "p50": ..., "p99": ...,
+ *                       "rss_peak_mb": ..., "rss_steady_mb": ...,
+ *                       "runs": [ ops_per_sec, ... ] }, ... ] }
+ *
+ * Entries are appended as benchmarks finish so that sweeps are recorded
+ * in full. The config string identifies a result for --compare.
+ */
+static FILE* report_file_;
+static int report_entries_;
+
+static void json_string(FILE* f, const char* s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(f, "\\u%04x", *s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+void report_config(char* buf, size_t size) {
+  snprintf(buf, size,
+           "num_keys=%ld num_ops=%ld reads=%ld value_size=%d value_size_dist=%s "
+           "page_size=%d num_pages=%d mmap_size_mb=%d batch_size=%d "
+           "checkpoint_granularity=%d journal_mode=%s synchronous=%s "
+           "transaction=%d write_percent=%d table_layout=%s key_encoding=%s "
+           "rng=%s unique_keys=%d txn_mode=%s json_storage=%s json_index=%s "
+           "temp_store=%s",
+           FLAGS_num_keys, FLAGS_num_ops, FLAGS_reads, FLAGS_value_size,
+           FLAGS_value_size_dist ? FLAGS_value_size_dist : "fixed",
+           FLAGS_page_size, FLAGS_num_pages, FLAGS_mmap_size_mb,
+           FLAGS_batch_size, FLAGS_checkpoint_granularity,
+           FLAGS_journal_mode ? FLAGS_journal_mode :
+               (FLAGS_WAL_enabled ? "WAL" : "OFF"),
+           FLAGS_synchronous ? FLAGS_synchronous : "auto",
+           FLAGS_transaction, FLAGS_write_percent, FLAGS_table_layout,
+           FLAGS_key_encoding, FLAGS_rng, FLAGS_unique_keys, FLAGS_txn_mode,
+           FLAGS_json_storage, FLAGS_json_index,
+           FLAGS_temp_store ? FLAGS_temp_store : "default");
+}
+
+void report_open(const char* path) {
+  time_t now = time(NULL);
+  char date[64];
+
+  report_file_ = fopen(path, "w");
+  if (report_file_ == NULL) {
+    perror(path);
+    exit(1);
+  }
+  report_entries_ = 0;
+
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  fprintf(report_file_, "{\n  \"sqlite_version\": ");
+  json_string(report_file_, sqlite3_libversion());
+  fprintf(report_file_, ",\n  \"date\": ");
+  json_string(report_file_, date);
+  fprintf(report_file_, ",\n  \"benchmarks\": [");
+}
+
+void report_add(const Result* r) {
+  int i;
+
+  if (report_file_ == NULL)
+    return;
+
+  fprintf(report_file_, "%s\n    {\"name\": ", report_entries_++ ? "," : "");
+  json_string(report_file_, r->name_);
+  fprintf(report_file_, ", \"config\": ");
+  json_string(report_file_, r->config_);
+  fprintf(report_file_, ",\n     \"ops_per_sec\": %.6f, \"micros_per_op\": %.6f,"
+          " \"p50\": %.6f, \"p99\": %.6f,\n     \"rss_peak_mb\": %.3f,"
+          " \"rss_steady_mb\": %.3f,\n     \"warmup_secs\": %.3f,"
+          " \"measured_secs\": %.3f, \"runs\": [",
+          r->ops_per_sec_, r->micros_per_op_, r->p50_, r->p99_,
+          r->rss_peak_mb_, r->rss_steady_mb_, r->warmup_secs_,
+          r->measured_secs_);
+  for (i = 0; i < r->num_runs_; i++)
+    fprintf(report_file_, "%s%.6f", i ? ", " : "", r->runs_[i]);
+  fprintf(report_file_, "]}");
+  fflush(report_file_);
+}
+
+void report_close() {
+  if (report_file_ == NULL)
+    return;
+
+  fprintf(report_file_, "\n  ]\n}\n");
+  fclose(report_file_);
+  report_file_ = NULL;
+}
@@ -0,0 +1,320 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/*
+ * rmwrandom and incrandom: --threads clients, each on a connection of its
+ * own, run transactions that read keys and then write the same keys back.
+ * rmwrandom reads a row of the test table and replaces its value;
+ * incrandom reads a counter from a small counters table and stores it
+ * plus one, so lost updates would show up in the final sum. Transactions
+ * start with BEGIN FLAGS_txn_mode. A DEFERRED transaction takes its write
+ * lock at its first write, which is where concurrent clients collide.
+ *
+ * SQLITE_BUSY first goes to a busy handler that backs off for up to
+ * FLAGS_busy_timeout_ms per wait (no handler when 0). If the statement
+ * still fails, the transaction is rolled back and retried from the start
+ * up to FLAGS_busy_retries times, and aborted after that.
+ */
+static const char *rmw_step_names[kNumRmwSteps] = {
+  "begin", "read", "write", "commit"
+};
+
+typedef struct Client {
+  pthread_t thread_;
+  int thread_num_;
+  bool counters_;
+  sqlite3 *db_;
+  sqlite3_stmt *begin_;
+  sqlite3_stmt *commit_;
+  sqlite3_stmt *rollback_;
+  sqlite3_stmt *read_;
+  sqlite3_stmt *write_;
+  Random rand_;
+  RandomGenerator gen_;
+  ValueSizeDist *dist_;
+  long num_txns_;
+  long num_entries_;
+  int batch_size_;
+  uint64_t wait_start_;
+  RmwStats stats_;
+} Client;
+
+/* Map --txn_mode to the statement that starts a transaction. */
+const char* txn_begin_sql() {
+  if (!strcasecmp(FLAGS_txn_mode, "deferred"))
+    return "BEGIN DEFERRED";
+  if (!strcasecmp(FLAGS_txn_mode, "immediate"))
+    return "BEGIN IMMEDIATE";
+  if (!strcasecmp(FLAGS_txn_mode, "exclusive"))
+    return "BEGIN EXCLUSIVE";
+
+  fprintf(stderr, "unknown transaction mode '%s'\n", FLAGS_txn_mode);
+  exit(1);
+}
+
+/* Sleep 50us, 100us, ... up to 12.8ms between tries, for up to the timeout. */
+static int busy_handler(void *arg, int count) {
+  Client *c = arg;
+  uint64_t t0 = now_nanos();
+
+  if (count == 0)
+    c->wait_start_ = t0;
+  else if (t0 - c->wait_start_ >= (uint64_t)FLAGS_busy_timeout_ms * 1000000)
+    return 0;
+  usleep(50 << (count < 8 ? count : 8));
+  c->stats_.busy_waits_++;
+  c->stats_.busy_nanos_ += now_nanos() - t0;
+
+  return 1;
+}
+
+static sqlite3_stmt* rmw_prepare(sqlite3 *db, const char *sql) {
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "prepare error: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+
+  return stmt;
+}
+
+/* Step stmt once; returns its status, exiting on anything but BUSY. */
+static int rmw_step(Client *c, sqlite3_stmt *stmt) {
+  int status = sqlite3_step(stmt);
+
+  if (status != SQLITE_ROW && status != SQLITE_DONE &&
+      (status & 0xff) != SQLITE_BUSY) {
+    fprintf(stderr, "SQL step error: %s\n", sqlite3_errmsg(c->db_));
+    exit(1);
+  }
+
+  return status;
+}
+
+/* Run one transaction; returns the step that got SQLITE_BUSY, or -1. */
+static int rmw_txn(Client *c, const long *keys) {
+  sqlite3_int64 n;
+  const char *value;
+  char key[100];
+  int value_size, status, j;
+
+  status = rmw_step(c, c->begin_);
+  sqlite3_reset(c->begin_);
+  if (status != SQLITE_DONE)
+    return RMW_BEGIN;
+
+  for (j = 0; j < c->batch_size_; j++) {
+    if (c->counters_)
+      sqlite3_bind_int64(c->read_, 1, keys[j]);
+    else
+      bind_key(c->read_, 1, key, keys[j]);
+    status = rmw_step(c, c->read_);
+    n = 0;
+    if (status == SQLITE_ROW && c->counters_)
+      n = sqlite3_column_int64(c->read_, 0);
+    else if (status == SQLITE_ROW && sqlite3_column_blob(c->read_, 0) != NULL)
+      c->stats_.read_bytes_ += sqlite3_column_bytes(c->read_, 0);
+    sqlite3_reset(c->read_);
+    if (status != SQLITE_ROW && status != SQLITE_DONE)
+      return RMW_READ;
+
+    if (c->counters_) {
+      sqlite3_bind_int64(c->write_, 1, n + 1);
+      sqlite3_bind_int64(c->write_, 2, keys[j]);
+    } else {
+      value_size = value_dist_next(c->dist_, &c->rand_);
+      value = rand_gen_generate(&c->gen_, value_size);
+      sqlite3_bind_blob(c->write_, 1, value, value_size, SQLITE_STATIC);
+      bind_key(c->write_, 2, key, keys[j]);
+    }
+    status = rmw_step(c, c->write_);
+    sqlite3_reset(c->write_);
+    if (status != SQLITE_DONE)
+      return RMW_WRITE;
+  }
+
+  status = rmw_step(c, c->commit_);
+  sqlite3_reset(c->commit_);
+  if (status != SQLITE_DONE)
+    return RMW_COMMIT;
+
+  return -1;
+}
+
+static void* client_main(void *arg) {
+  Client *c = arg;
+  long *keys = malloc(sizeof(long) * c->batch_size_);
+  uint64_t t0;
+  int attempt, step, j;
+  long i;
+
+  affinity_pin(c->thread_num_);
+  for (i = 0; i < c->num_txns_ && !deadline_passed(); i++) {
+    /* A retry works on the same keys. */
+    for (j = 0; j < c->batch_size_; j++)
+      keys[j] = rand_key(&c->rand_, c->num_entries_);
+
+    t0 = now_nanos();
+    for (attempt = 0; ; attempt++) {
+      step = rmw_txn(c, keys);
+      if (step < 0) {
+        c->stats_.txns_++;
+        histogram_add(&c->stats_.latency_, (now_nanos() - t0) / 1e3);
+        break;
+      }
+      c->stats_.busy_[step]++;
+      if (!sqlite3_get_autocommit(c->db_)) {
+        rmw_step(c, c->rollback_);
+        sqlite3_reset(c->rollback_);
+      }
+      if (attempt >= FLAGS_busy_retries) {
+        c->stats_.aborts_++;
+        break;
+      }
+      c->stats_.retries_++;
+      /* Randomized backoff keeps the losers from colliding again. */
+      usleep(rand_uniform(&c->rand_, 100 << (attempt < 6 ? attempt : 6)));
+    }
+  }
+  free(keys);
+
+  return NULL;
+}
+
+static void exec_or_die(sqlite3 *db, const char *sql) {
+  char *err_msg = NULL;
+
+  if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", err_msg);
+    exit(1);
+  }
+}
+
+static sqlite3_int64 counter_sum(sqlite3 *db) {
+  sqlite3_stmt *stmt = rmw_prepare(db, "SELECT total(n) FROM counters");
+  sqlite3_int64 sum = 0;
+
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    sum = (sqlite3_int64)sqlite3_column_double(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return sum;
+}
+
+/*
+ * Run num_ops keys' worth of transactions of batch_size keys each, split
+ * over num_clients. db is the benchmark's own connection; it creates the
+ * counters table for incrandom and checks the sum afterwards.
+ */
+void rmw_run(sqlite3 *db, bool counters, int num_clients, long num_ops,
+             long num_entries, ValueSizeDist *dist, int batch_size,
+             RmwStats *stats) {
+  const char *path = sqlite3_db_filename(db, "main");
+  Client *clients = calloc(num_clients, sizeof(Client));
+  char sql[256];
+  double start;
+  int i, s;
+
+  memset(stats, 0, sizeof(*stats));
+  histogram_clear(&stats->latency_);
+  stats->clients_ = num_clients;
+  stats->counters_ = counters;
+  if (counters) {
+    num_entries = FLAGS_counter_rows;
+    exec_or_die(db, "CREATE TABLE IF NOT EXISTS counters "
+                "(id INTEGER PRIMARY KEY, n INTEGER NOT NULL)");
+    snprintf(sql, sizeof(sql), "DELETE FROM counters; "
+             "WITH RECURSIVE c(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM c "
+             "WHERE i < %ld) INSERT INTO counters SELECT i, 0 FROM c",
+             num_entries - 1);
+    exec_or_die(db, sql);
+  }
+
+  for (i = 0; i < num_clients; i++) {
+    Client *c = &clients[i];
+
+    c->thread_num_ = 1 + i;
+    c->counters_ = counters;
+    c->db_ = concurrent_open(path);
+    if (FLAGS_busy_timeout_ms > 0)
+      sqlite3_busy_handler(c->db_, busy_handler, c);
+    else
+      sqlite3_busy_handler(c->db_, NULL, NULL);
+    c->begin_ = rmw_prepare(c->db_, txn_begin_sql());
+    c->commit_ = rmw_prepare(c->db_, "COMMIT");
+    c->rollback_ = rmw_prepare(c->db_, "ROLLBACK");
+    c->read_ = rmw_prepare(c->db_, counters ?
+                           "SELECT n FROM counters WHERE id = ?" :
+                           "SELECT value FROM test WHERE key = ?");
+    c->write_ = rmw_prepare(c->db_, counters ?
+                            "UPDATE counters SET n = ? WHERE id = ?" :
+                            "UPDATE test SET value = ? WHERE key = ?");
+    c->dist_ = dist;
+    c->num_entries_ = num_entries;
+    c->batch_size_ = batch_size;
+    c->num_txns_ = num_ops / batch_size / num_clients;
+    rand_seed(&c->rand_, 4000, i);
+    rand_gen_init(&c->gen_, FLAGS_compression_ratio);
+    histogram_clear(&c->stats_.latency_);
+  }
+
+  start = now_micros() * 1e-6;
+  for (i = 0; i < num_clients; i++)
+    pthread_create(&clients[i].thread_, NULL, client_main, &clients[i]);
+  for (i = 0; i < num_clients; i++) {
+    Client *c = &clients[i];
+
+    pthread_join(c->thread_, NULL);
+    histogram_merge(&stats->latency_, &c->stats_.latency_);
+    stats->txns_ += c->stats_.txns_;
+    stats->retries_ += c->stats_.retries_;
+    stats->aborts_ += c->stats_.aborts_;
+    for (s = 0; s < kNumRmwSteps; s++)
+      stats->busy_[s] += c->stats_.busy_[s];
+    stats->busy_waits_ += c->stats_.busy_waits_;
+    stats->busy_nanos_ += c->stats_.busy_nanos_;
+    stats->read_bytes_ += c->stats_.read_bytes_;
+    sqlite3_finalize(c->begin_);
+    sqlite3_finalize(c->commit_);
+    sqlite3_finalize(c->rollback_);
+    sqlite3_finalize(c->read_);
+    sqlite3_finalize(c->write_);
+    sqlite3_close(c->db_);
+    free(c->gen_.data_);
+  }
+  stats->seconds_ = now_micros() * 1e-6 - start;
+  stats->keys_ = stats->txns_ * batch_size;
+  if (counters)
+    stats->lost_updates_ = stats->keys_ - counter_sum(db);
+  free(clients);
+}
+
+void rmw_print(RmwStats *stats) {
+  long attempts = stats->txns_ + stats->aborts_ + stats->retries_;
+  int s;
+
+  fprintf(stderr, "  %ld committed, %ld aborted (%.2f%%), %ld retries "
+          "(%.2f per txn), %.1f txns/sec\n", stats->txns_, stats->aborts_,
+          stats->txns_ + stats->aborts_ ?
+          100.0 * stats->aborts_ / (stats->txns_ + stats->aborts_) : 0.0,
+          stats->retries_,
+          stats->txns_ ? (double)stats->retries_ / stats->txns_ : 0.0,
+          stats->seconds_ > 0 ? stats->txns_ / stats->seconds_ : 0.0);
+  fprintf(stderr, "  SQLITE_BUSY at");
+  for (s = 0; s < kNumRmwSteps; s++)
+    fprintf(stderr, " %s %ld%s", rmw_step_names[s], stats->busy_[s],
+            s + 1 < kNumRmwSteps ? "," : "");
+  fprintf(stderr, " (%.2f%% of attempts)\n", attempts ?
+          100.0 * (stats->aborts_ + stats->retries_) / attempts : 0.0);
+  fprintf(stderr, "  busy handler: %ld waits, %.3f s waiting (%.1f%% of "
+          "client time)\n", stats->busy_waits_, stats->busy_nanos_ * 1e-9,
+          stats->seconds_ > 0 ? 100.0 * stats->busy_nanos_ * 1e-9 /
+          (stats->seconds_ * stats->clients_) : 0.0);
+  if (stats->counters_)
+    fprintf(stderr, "  %ld increments, %ld lost updates\n", stats->keys_,
+            stats->lost_updates_);
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#include <inttypes.h>
+
+/*
+ * Slow-operation tracer. Every op the benchmark thread finishes goes
+ * through slowop_record, which samples the VFS counters, the checkpoint
+ * sequence and the connection's page cache counters. An op that took at
+ * least FLAGS_slow_op_us gets one JSON line in FLAGS_slow_op_log with its
+ * key, its place in the transaction, the WAL size and the deltas of those
+ * counters over that op alone, so a tail-latency outlier can be traced to
+ * a checkpoint, a cache spill, a sync or plain reads.
+ */
+typedef struct OpCounters {
+  IoStats io_;
+  uint64_t checkpoint_seq_;
+  int cache_miss_;
+  int cache_write_;
+  int cache_spill_;
+  long binds_;
+} OpCounters;
+
+static FILE *log_;
+static sqlite3 *trace_db_;
+static char benchmark_[128];
+static OpCounters last_;
+static long txn_binds_;
+static double trace_start_;
+static long num_slow_;
+
+static int db_counter(int op) {
+  int cur = 0, hi;
+
+  sqlite3_db_status(trace_db_, op, &cur, &hi, 0);
+  return cur;
+}
+
+static void sample(OpCounters *c) {
+  iostat_get(&c->io_);
+  c->checkpoint_seq_ = wal_checkpoint_seq();
+  c->cache_miss_ = db_counter(SQLITE_DBSTATUS_CACHE_MISS);
+  c->cache_write_ = db_counter(SQLITE_DBSTATUS_CACHE_WRITE);
+  c->cache_spill_ = db_counter(SQLITE_DBSTATUS_CACHE_SPILL);
+  c->binds_ = key_binds();
+}
+
+/* Open the log; keys are only tracked while tracing. */
+void slowop_open(const char *path) {
+  log_ = fopen(path, "w");
+  if (log_ == NULL) {
+    perror(path);
+    exit(1);
+  }
+  key_trace(true);
+}
+
+/* Name the benchmark whose ops are logged next. */
+void slowop_benchmark(const char *name) {
+  snprintf(benchmark_, sizeof(benchmark_), "%s", name);
+}
+
+/* Start a measurement on db: take the baseline and zero the count. */
+void slowop_reset(sqlite3 *db) {
+  trace_db_ = db;
+  sample(&last_);
+  txn_binds_ = -1;
+  trace_start_ = now_micros() * 1e-6;
+  num_slow_ = 0;
+}
+
+/* Called at BEGIN, so a slow op knows how far into its transaction it is. */
+void slowop_txn_begin() {
+  txn_binds_ = key_binds();
+}
+
+#define DELTA(field) (now.field - last_.field)
+
+void slowop_record(bool write, long op, double micros) {
+  OpCounters now;
+
+  sample(&now);
+  if (micros >= FLAGS_slow_op_us) {
+    num_slow_++;
+    fprintf(log_, "{\"benchmark\": \"%s\", \"op\": %ld, \"t\": %.6f, "
+            "\"kind\": \"%s\", \"micros\": %.1f, \"key\": %ld, "
+            "\"op_keys\": %ld, \"txn_pos\": %ld, \"in_txn\": %d, "
+            "\"wal_frames\": %d, \"checkpoint\": %d, "
+            "\"cache_miss\": %d, \"cache_write\": %d, \"cache_spill\": %d, "
+            "\"reads\": %" PRIu64 ", \"read_bytes\": %" PRIu64 ", "
+            "\"writes\": %" PRIu64 ", \"write_bytes\": %" PRIu64 ", "
+            "\"syncs\": %" PRIu64 ", \"sync_micros\": %.1f, "
+            "\"fetch_misses\": %" PRIu64 "}\n",
+            benchmark_, op, now_micros() * 1e-6 - trace_start_,
+            write ? "write" : "read", micros, key_last(), DELTA(binds_),
+            txn_binds_ < 0 ? -1 : now.binds_ - txn_binds_,
+            !sqlite3_get_autocommit(trace_db_), wal_frames(),
+            DELTA(checkpoint_seq_) != 0,
+            DELTA(cache_miss_), DELTA(cache_write_), DELTA(cache_spill_),
+            DELTA(io_.reads_), DELTA(io_.read_bytes_),
+            DELTA(io_.writes_), DELTA(io_.write_bytes_),
+            DELTA(io_.syncs_), DELTA(io_.sync_nanos_) / 1e3,
+            DELTA(io_.fetch_misses_));
+  }
+  last_ = now;
+}
+
+/* Print how many ops of the last measurement were logged. */
+void slowop_print() {
+  fflush(log_);
+  fprintf(stderr, "  slow ops   : %ld at or over %d micros, logged to %s\n",
+          num_slow_, FLAGS_slow_op_us, FLAGS_slow_op_log);
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+/* Two-sided 95% critical values of Student's t for 1..30 degrees of freedom. */
+const static double t_table[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+double stats_mean(const double* v, int n) {
+  double sum = 0;
+  int i;
+
+  if (n == 0)
+    return 0;
+  for (i = 0; i < n; i++)
+    sum += v[i];
+
+  return sum / n;
+}
+
+double stats_median(const double* v, int n) {
+  double *sorted;
+  double median;
+
+  if (n == 0)
+    return 0;
+
+  sorted = malloc(sizeof(double) * n);
+  memcpy(sorted, v, sizeof(double) * n);
+  qsort(sorted, n, sizeof(double), compare_doubles);
+  median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+  free(sorted);
+
+  return median;
+}
+
+/* Sample standard deviation. */
+double stats_stddev(const double* v, int n) {
+  double mean = stats_mean(v, n);
+  double sum = 0;
+  int i;
+
+  if (n < 2)
+    return 0;
+  for (i = 0; i < n; i++)
+    sum += (v[i] - mean) * (v[i] - mean);
+
+  return sqrt(sum / (n - 1));
+}
+
+/* Coefficient of variation, as a fraction of the mean. */
+double stats_cv(const double* v, int n) {
+  double mean = stats_mean(v, n);
+
+  return (mean == 0) ? 0 : stats_stddev(v, n) / mean;
+}
+
+double stats_t_critical(double df) {
+  if (df < 1)
+    return t_table[0];
+  if (df <= 30)
+    return t_table[(int)df - 1];
+
+  return 1.960;
+}
+
+/* Half-width of the 95% confidence interval of the mean. */
+double stats_ci95(const double* v, int n) {
+  if (n < 2)
+    return 0;
+
+  return stats_t_critical(n - 1) * stats_stddev(v, n) / sqrt(n);
+}
+
+/*
+ * Welch's t-test for two samples with unequal variances. Returns true if
+ * the difference of the means is significant at the 95% level.
+ */
+bool stats_welch(const double* a, int na, const double* b, int nb,
+                 double* t, double* df) {
+  double va, vb, se;
+
+  *t = 0;
+  *df = 0;
+  if (na < 2 || nb < 2)
+    return false;
+
+  va = stats_stddev(a, na) * stats_stddev(a, na) / na;
+  vb = stats_stddev(b, nb) * stats_stddev(b, nb) / nb;
+  se = sqrt(va + vb);
+  if (se == 0)
+    return stats_mean(a, na) != stats_mean(b, nb);
+
+  *t = (stats_mean(b, nb) - stats_mean(a, na)) / se;
+  *df = (va + vb) * (va + vb) /
+        (va * va / (na - 1) + vb * vb / (nb - 1));
+
+  return fabs(*t) > stats_t_critical(*df);
+}
@@ -0,0 +1,249 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#define kMaxSweepDims 8
+#define kMaxSweepValues 64
+
+/*
+ * A sweep runs the selected benchmarks once for every point in the
+ * cartesian product of the swept parameters, each on a fresh database.
+ * Dimensions are separated by ';' and take either a list of values
+ * (page_size=1024,4096) or a range LO:HI:STEP where STEP is an
+ * increment or, with an 'x' prefix, a factor (num_pages=1000:16000:x2).
+ */
+typedef struct SweepDim {
+  char *name_;
+  int num_values_;
+  char *values_[kMaxSweepValues];
+} SweepDim;
+
+typedef struct SweepParam {
+  const char *name_;
+  int *int_flag_;
+  char **str_flag_;
+} SweepParam;
+
+static const SweepParam sweep_params[] = {
+  { "page_size", &FLAGS_page_size, NULL },
+  { "num_pages", &FLAGS_num_pages, NULL },
+  { "mmap_size_mb", &FLAGS_mmap_size_mb, NULL },
+  { "batch_size", &FLAGS_batch_size, NULL },
+  { "checkpoint_granularity", &FLAGS_checkpoint_granularity, NULL },
+  { "journal_mode", NULL, &FLAGS_journal_mode },
+  { "synchronous", NULL, &FLAGS_synchronous },
+  { "table_layout", NULL, &FLAGS_table_layout },
+  { "key_encoding", NULL, &FLAGS_key_encoding },
+  { "txn_mode", NULL, &FLAGS_txn_mode },
+  { "json_fields", &FLAGS_json_fields, NULL },
+  { "json_depth", &FLAGS_json_depth, NULL },
+  { "json_storage", NULL, &FLAGS_json_storage },
+  { "json_index", NULL, &FLAGS_json_index },
+  { "temp_store", NULL, &FLAGS_temp_store },
+};
+
+#define kNumSweepParams (sizeof(sweep_params) / sizeof(sweep_params[0]))
+
+static const SweepParam* sweep_param(const char *name) {
+  size_t i;
+
+  for (i = 0; i < kNumSweepParams; i++)
+    if (!strcmp(sweep_params[i].name_, name))
+      return &sweep_params[i];
+
+  return NULL;
+}
+
+static void sweep_add_value(SweepDim *dim, const char *value) {
+  if (dim->num_values_ == kMaxSweepValues) {
+    fprintf(stderr, "sweep: too many values for %s\n", dim->name_);
+    exit(1);
+  }
+  dim->values_[dim->num_values_++] = strdup(value);
+}
+
+/* Expand LO:HI:STEP into a list of values; returns false if not a range. */
+static bool sweep_parse_range(SweepDim *dim, const char *spec) {
+  char buf[32];
+  long lo, hi, step;
+  char mult;
+  long v;
+
+  if (sscanf(spec, "%ld:%ld:x%ld", &lo, &hi, &step) == 3) {
+    mult = 'x';
+  } else if (sscanf(spec, "%ld:%ld:+%ld", &lo, &hi, &step) == 3 ||
+             sscanf(spec, "%ld:%ld:%ld", &lo, &hi, &step) == 3) {
+    mult = '+';
+  } else {
+    return false;
+  }
+
+  if (step < (mult == 'x' ? 2 : 1) || lo > hi || (mult == 'x' && lo < 1)) {
+    fprintf(stderr, "sweep: bad range '%s'\n", spec);
+    exit(1);
+  }
+
+  for (v = lo; v <= hi; v = (mult == 'x') ? v * step : v + step) {
+    snprintf(buf, sizeof(buf), "%ld", v);
+    sweep_add_value(dim, buf);
+  }
+
+  return true;
+}
+
+static int sweep_parse(char *spec, SweepDim *dims) {
+  char *copy = strdup(spec);
+  char *dim_spec, *save_dim, *value, *save_value, *eq;
+  int num_dims = 0;
+
+  for (dim_spec = strtok_r(copy, ";", &save_dim); dim_spec != NULL;
+       dim_spec = strtok_r(NULL, ";", &save_dim)) {
+    eq = strchr(dim_spec, '=');
+    if (eq == NULL) {
+      fprintf(stderr, "sweep: expected PARAM=VALUES in '%s'\n", dim_spec);
+      exit(1);
+    }
+    *eq = '\0';
+    if (sweep_param(dim_spec) == NULL) {
+      fprintf(stderr, "sweep: cannot sweep '%s'\n", dim_spec);
+      exit(1);
+    }
+    if (num_dims == kMaxSweepDims) {
+      fprintf(stderr, "sweep: too many parameters\n");
+      exit(1);
+    }
+
+    SweepDim *dim = &dims[num_dims++];
+    dim->name_ = strdup(dim_spec);
+    dim->num_values_ = 0;
+    for (value = strtok_r(eq + 1, ",", &save_value); value != NULL;
+         value = strtok_r(NULL, ",", &save_value)) {
+      if (!sweep_parse_range(dim, value))
+        sweep_add_value(dim, value);
+    }
+    if (dim->num_values_ == 0) {
+      fprintf(stderr, "sweep: no values for %s\n", dim->name_);
+      exit(1);
+    }
+  }
+  free(copy);
+
+  return num_dims;
+}
+
+/* Apply point number idx of the sweep and describe it in config. */
+static void sweep_apply(SweepDim *dims, int num_dims, int idx,
+                        char *config, size_t config_size) {
+  const SweepParam *param;
+  size_t len = 0;
+  char *value;
+  int d;
+
+  config[0] = '\0';
+  for (d = num_dims - 1; d >= 0; d--) {
+    value = dims[d].values_[idx % dims[d].num_values_];
+    idx /= dims[d].num_values_;
+
+    param = sweep_param(dims[d].name_);
+    if (param->int_flag_ != NULL)
+      *param->int_flag_ = atoi(value);
+    else
+      *param->str_flag_ = value;
+  }
+
+  for (d = 0; d < num_dims; d++) {
+    param = sweep_param(dims[d].name_);
+    if (param->int_flag_ != NULL)
+      len += snprintf(config + len, config_size - len, "%s%s=%d",
+                      d ? " " : "", dims[d].name_, *param->int_flag_);
+    else
+      len += snprintf(config + len, config_size - len, "%s%s=%s",
+                      d ? " " : "", dims[d].name_, *param->str_flag_);
+    if (len >= config_size)
+      break;
+  }
+}
+
+void sweep_run() {
+  SweepDim dims[kMaxSweepDims];
+  char **configs;
+  Result *results;
+  int *num_results;
+  int num_dims, num_points, num_names;
+  int p, i, j, best;
+  int config_width = 6;
+
+  num_dims = sweep_parse(FLAGS_sweep, dims);
+  num_points = 1;
+  for (i = 0; i < num_dims; i++)
+    num_points *= dims[i].num_values_;
+
+  configs = malloc(sizeof(char *) * num_points);
+  num_results = malloc(sizeof(int) * num_points);
+  results = NULL;
+  num_names = 0;
+
+  for (p = 0; p < num_points; p++) {
+    configs[p] = malloc(512);
+    sweep_apply(dims, num_dims, p, configs[p], 512);
+    if ((int)strlen(configs[p]) > config_width)
+      config_width = strlen(configs[p]);
+
+    fprintf(stderr, "Sweep %d/%d: %s\n", p + 1, num_points, configs[p]);
+    benchmark_clear_results();
+    benchmark_run();
+    benchmark_destroy();
+
+    /* Benchmarks are the columns of the table: take them from the first point. */
+    num_results[p] = benchmark_num_results();
+    if (p == 0) {
+      num_names = num_results[p];
+      results = malloc(sizeof(Result) * num_points * (num_names ? num_names : 1));
+    }
+    for (i = 0; i < num_names && i < num_results[p]; i++) {
+      results[p * num_names + i] = *benchmark_result(i);
+      results[p * num_names + i].runs_ = NULL;
+    }
+  }
+
+  fprintf(stderr, "------------------------------------------------\n");
+  fprintf(stderr, "Sweep results (ops/sec)\n");
+  fprintf(stderr, "%-*s", config_width, "config");
+  for (i = 0; i < num_names; i++)
+    fprintf(stderr, " %14s", results[i].name_);
+  fprintf(stderr, "\n");
+  for (p = 0; p < num_points; p++) {
+    fprintf(stderr, "%-*s", config_width, configs[p]);
+    for (i = 0; i < num_names; i++) {
+      if (i < num_results[p])
+        fprintf(stderr, " %14.1f", results[p * num_names + i].ops_per_sec_);
+      else
+        fprintf(stderr, " %14s", "-");
+    }
+    fprintf(stderr, "\n");
+  }
+
+  fprintf(stderr, "Best configuration per workload:\n");
+  for (i = 0; i < num_names; i++) {
+    best = -1;
+    for (j = 0; j < num_points; j++) {
+      if (i >= num_results[j])
+        continue;
+      if (best < 0 || results[j * num_names + i].ops_per_sec_ >
+                      results[best * num_names + i].ops_per_sec_)
+        best = j;
+    }
+    if (best >= 0)
+      fprintf(stderr, "%-12s : %14.1f ops/sec; p99 %.3f micros; %s\n",
+              results[i].name_, results[best * num_names + i].ops_per_sec_,
+              results[best * num_names + i].p99_, configs[best]);
+  }
+
+  for (p = 0; p < num_points; p++)
+    free(configs[p]);
+  free(configs);
+  free(num_results);
+  free(results);
+}
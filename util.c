@@ -11,6 +11,87 @@ uint64_t now_micros() {
   return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
 }
 
+uint64_t now_nanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Shared by every benchmark thread; 0 means no deadline. */
+static uint64_t deadline_;
+
+/* Make deadline_passed() true seconds from now; 0 clears the deadline. */
+void deadline_set(double seconds) {
+  __atomic_store_n(&deadline_, seconds > 0 ?
+                   now_nanos() + (uint64_t)(seconds * 1e9) : 0,
+                   __ATOMIC_RELAXED);
+}
+
+bool deadline_passed() {
+  uint64_t deadline = __atomic_load_n(&deadline_, __ATOMIC_RELAXED);
+
+  return deadline != 0 && now_nanos() >= deadline;
+}
+
+uint64_t phys_mem_bytes() {
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  return pages > 0 && page_size > 0 ? (uint64_t)pages * page_size : 1;
+}
+
+#if defined(__linux)
+typedef unsigned char mincore_vec_t;
+#else
+typedef char mincore_vec_t;
+#endif
+
+/* Fraction of fd's pages in the OS page cache, from mincore. */
+static double file_resident(int fd) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  mincore_vec_t *vec;
+  struct stat st;
+  size_t pages, i, resident = 0;
+  void *addr;
+
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+    return 0;
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    return 0;
+  pages = (st.st_size + page_size - 1) / page_size;
+  vec = malloc(pages);
+  if (mincore(addr, st.st_size, vec) == 0)
+    for (i = 0; i < pages; i++)
+      resident += vec[i] & 1;
+  free(vec);
+  munmap(addr, st.st_size);
+
+  return (double)resident / pages;
+}
+
+/*
+ * Write back path and drop its pages from the OS page cache, which needs
+ * no privileges: POSIX_FADV_DONTNEED drops clean pages only, so the file
+ * is synced first. Returns the fraction still resident afterwards, or -1
+ * if path does not exist.
+ */
+double file_evict(const char *path) {
+  double resident;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  fsync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  resident = file_resident(fd);
+  close(fd);
+
+  return resident;
+}
+
 /*
  * https://stackoverflow.com/questions/4770985/how-to-check-if-a-string-starts-with-another-string-in-c 
  */
@@ -0,0 +1,209 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "bench.h"
+
+#include <inttypes.h>
+
+/*
+ * Run WAL checkpoints from a wal hook instead of SQLite's autocheckpoint,
+ * so other threads can tell when a checkpoint is in progress and the
+ * benchmark can time each one. The sequence number is odd while a
+ * checkpoint runs; a reader that sees it odd, or sees it change across an
+ * operation, overlapped a checkpoint.
+ */
+static uint64_t checkpoint_seq_;
+static WalStats wal_stats_;
+static int wal_frames_;
+
+/*
+ * With --wal_timeline, every commit's WAL size and every checkpoint's
+ * mode, frames and pause are kept from start() to stop() and summarized
+ * per benchmark, and appended to the timeline file as CSV.
+ */
+typedef struct WalEvent {
+  uint64_t nanos_;
+  uint64_t pause_nanos_;
+  int mode_;
+  int frames_;
+  int checkpointed_;
+} WalEvent;
+
+#define kWalCommit -1
+
+static pthread_mutex_t timeline_mu_ = PTHREAD_MUTEX_INITIALIZER;
+static FILE *timeline_;
+static bool recording_;
+static uint64_t timeline_start_;
+static int page_size_;
+static WalEvent *events_;
+static long num_events_;
+static long max_events_;
+
+static const char *mode_names[] = { "passive", "full", "restart", "truncate" };
+
+static void record(int mode, int frames, int checkpointed, uint64_t t0,
+                   uint64_t pause) {
+  WalEvent *e;
+
+  if (!__atomic_load_n(&recording_, __ATOMIC_RELAXED))
+    return;
+  pthread_mutex_lock(&timeline_mu_);
+  if (num_events_ == max_events_) {
+    max_events_ = max_events_ ? 2 * max_events_ : 4096;
+    events_ = realloc(events_, sizeof(WalEvent) * max_events_);
+  }
+  e = &events_[num_events_++];
+  e->nanos_ = t0 - timeline_start_;
+  e->pause_nanos_ = pause;
+  e->mode_ = mode;
+  e->frames_ = frames;
+  e->checkpointed_ = checkpointed;
+  pthread_mutex_unlock(&timeline_mu_);
+}
+
+/* Checkpoint db, marking it in the sequence number and timing it. */
+static void checkpoint(sqlite3 *db, const char *name, int mode) {
+  int log_frames = 0, checkpointed = 0;
+  uint64_t t0, nanos, max;
+
+  __atomic_fetch_add(&checkpoint_seq_, 1, __ATOMIC_RELEASE);
+  t0 = now_nanos();
+  sqlite3_wal_checkpoint_v2(db, name, mode, &log_frames, &checkpointed);
+  nanos = now_nanos() - t0;
+  __atomic_fetch_add(&checkpoint_seq_, 1, __ATOMIC_RELEASE);
+  record(mode, log_frames, checkpointed, t0, nanos);
+
+  __atomic_fetch_add(&wal_stats_.checkpoints_, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&wal_stats_.checkpoint_nanos_, nanos, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&wal_stats_.frames_, (uint64_t)checkpointed,
+                     __ATOMIC_RELAXED);
+  max = __atomic_load_n(&wal_stats_.max_checkpoint_nanos_, __ATOMIC_RELAXED);
+  while (nanos > max &&
+         !__atomic_compare_exchange_n(&wal_stats_.max_checkpoint_nanos_, &max,
+                                      nanos, false, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+    ;
+}
+
+static int wal_hook(void *arg, sqlite3 *db, const char *name, int frames) {
+  int granularity = (int)(intptr_t)arg;
+
+  __atomic_store_n(&wal_frames_, frames, __ATOMIC_RELAXED);
+  record(kWalCommit, frames, 0, now_nanos(), 0);
+  if (granularity > 0 && frames >= granularity)
+    checkpoint(db, name, SQLITE_CHECKPOINT_PASSIVE);
+
+  return SQLITE_OK;
+}
+
+/* Run a checkpoint of the given mode on every attached database. */
+void wal_checkpoint_run(sqlite3 *db, int mode) {
+  checkpoint(db, NULL, mode);
+}
+
+/* Checkpoint db once its WAL holds at least granularity frames. */
+void wal_hook_install(sqlite3 *db, int granularity) {
+  sqlite3_wal_hook(db, wal_hook, (void *)(intptr_t)granularity);
+}
+
+/* Frames in the WAL after the last commit that went through the hook. */
+int wal_frames() {
+  return __atomic_load_n(&wal_frames_, __ATOMIC_RELAXED);
+}
+
+uint64_t wal_checkpoint_seq() {
+  return __atomic_load_n(&checkpoint_seq_, __ATOMIC_ACQUIRE);
+}
+
+/* Start a new window for the longest checkpoint. */
+void wal_stats_reset_max() {
+  __atomic_store_n(&wal_stats_.max_checkpoint_nanos_, 0, __ATOMIC_RELAXED);
+}
+
+void wal_stats_get(WalStats *stats) {
+  stats->checkpoints_ = __atomic_load_n(&wal_stats_.checkpoints_, __ATOMIC_RELAXED);
+  stats->checkpoint_nanos_ = __atomic_load_n(&wal_stats_.checkpoint_nanos_, __ATOMIC_RELAXED);
+  stats->max_checkpoint_nanos_ = __atomic_load_n(&wal_stats_.max_checkpoint_nanos_, __ATOMIC_RELAXED);
+  stats->frames_ = __atomic_load_n(&wal_stats_.frames_, __ATOMIC_RELAXED);
+}
+
+/* Open the CSV timeline; recording starts with wal_timeline_start. */
+void wal_timeline_open(const char *path) {
+  timeline_ = fopen(path, "w");
+  if (timeline_ == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fprintf(timeline_, "benchmark,seconds,event,wal_frames,wal_bytes,"
+          "checkpointed,pause_us\n");
+}
+
+void wal_timeline_start(int page_size) {
+  pthread_mutex_lock(&timeline_mu_);
+  num_events_ = 0;
+  page_size_ = page_size;
+  timeline_start_ = now_nanos();
+  pthread_mutex_unlock(&timeline_mu_);
+  __atomic_store_n(&recording_, true, __ATOMIC_RELAXED);
+}
+
+/* Bytes a WAL of this many frames takes: a header, then frame headers and pages. */
+static int64_t wal_bytes(int frames) {
+  return frames > 0 ? 32 + (int64_t)frames * (24 + page_size_) : 0;
+}
+
+/* Stop recording, print the summary for name and append its timeline. */
+void wal_timeline_stop(const char *name) {
+  long commits = 0, checkpoints = 0, by_mode[4] = { 0, 0, 0, 0 };
+  double frames_sum = 0, written = 0, pause_sum = 0, secs;
+  int peak = 0;
+  Histogram pauses;
+  WalEvent *e;
+  long i;
+
+  __atomic_store_n(&recording_, false, __ATOMIC_RELAXED);
+  secs = (now_nanos() - timeline_start_) * 1e-9;
+  histogram_clear(&pauses);
+
+  pthread_mutex_lock(&timeline_mu_);
+  for (i = 0; i < num_events_; i++) {
+    e = &events_[i];
+    if (e->mode_ == kWalCommit) {
+      commits++;
+      frames_sum += e->frames_;
+      if (e->frames_ > peak)
+        peak = e->frames_;
+    } else {
+      checkpoints++;
+      if (e->mode_ >= 0 && e->mode_ < 4)
+        by_mode[e->mode_]++;
+      written += e->checkpointed_;
+      pause_sum += e->pause_nanos_;
+      histogram_add(&pauses, e->pause_nanos_ / 1e3);
+    }
+    if (timeline_ != NULL)
+      fprintf(timeline_, "%s,%.6f,%s,%d,%" PRId64 ",%d,%.1f\n", name,
+              e->nanos_ * 1e-9,
+              e->mode_ == kWalCommit ? "commit" : mode_names[e->mode_],
+              e->frames_, wal_bytes(e->frames_),
+              e->mode_ == kWalCommit ? 0 : e->checkpointed_,
+              e->pause_nanos_ / 1e3);
+  }
+  pthread_mutex_unlock(&timeline_mu_);
+  if (timeline_ != NULL)
+    fflush(timeline_);
+
+  fprintf(stderr, "  WAL        : %ld commits, size mean %.0f peak %d frames "
+          "(%.1f MB); %ld checkpoints (%ld passive, %ld full, %ld restart, "
+          "%ld truncate)\n", commits, commits ? frames_sum / commits : 0.0,
+          peak, wal_bytes(peak) / 1048576.0, checkpoints, by_mode[0],
+          by_mode[1], by_mode[2], by_mode[3]);
+  if (checkpoints > 0)
+    fprintf(stderr, "  checkpoint : pause p50 %.3f p99 %.3f max %.3f ms; "
+            "%.0f frames each; %.1f%% of run\n",
+            histogram_percentile(&pauses, 50) / 1e3,
+            histogram_percentile(&pauses, 99) / 1e3, pauses.max_ / 1e3,
+            written / checkpoints, secs > 0 ? pause_sum * 1e-9 / secs * 100 : 0.0);
+}